@@ -0,0 +1,310 @@
+#include <stdio.h>  /* FILE, fopen, fclose, printf, fprintf, stdin, stderr */
+#include <stdlib.h> /* EXIT_SUCCESS, EXIT_FAILURE, malloc, calloc, free */
+#include <string.h> /* memchr, strcpy */
+#include <stdint.h> /* uint64_t, UINT64_MAX */
+#include <math.h>   /* floorl, fabsl, log, pow, INFINITY */
+
+#include "cli.h"
+
+#ifdef HAVE_POSIX
+#include <pthread.h> /* pthread_* */
+#include <unistd.h>  /* sysconf */
+#endif
+
+/* Quantiles are estimated from counts of values in buckets growing by a
+ * factor of AGG_GAMMA, so that each is within AGG_ALPHA of the truth,
+ * relative to its value, from AGG_MIN upto AGG_MIN * AGG_GAMMA^AGG_BUCKETS
+ * seconds, about 540,000 years. Bucket 0 counts values of 0, and values
+ * beyond the range count in the first or last bucket.
+ */
+#define AGG_ALPHA   0.005
+#define AGG_GAMMA   ((1+AGG_ALPHA) / (1-AGG_ALPHA))
+#define AGG_MIN     1e-9
+#define AGG_BUCKETS 5120
+
+/* Quantiles written, in thousandths so their ranks are exact, and their
+ * names
+ */
+static const struct {
+	unsigned q;
+	const char *name;
+} quantiles[] = {
+	{500, "p50"}, {900, "p90"}, {990, "p99"}, {999, "p99.9"}
+};
+
+/* Aggregate of values of seconds, which two of merge exactly */
+typedef struct agg {
+	unsigned long long n, bad; /* Values added, and lines that weren't */
+	long double min, max;
+	/* Whole seconds below 2^64 of each value, summed exactly as a 128-bit
+	 * integer of hi*2^64 + lo, and the rest compensated for rounding.
+	 */
+	uint64_t hi, lo;
+	long double rest, comp;
+	unsigned long long buckets[AGG_BUCKETS];
+} agg;
+
+static void agg_init(agg *a)
+{
+	*a = (agg){.min = INFINITY};
+}
+
+/* Adds x to *sum, carrying what's lost to rounding into *comp (Neumaier) */
+static void sum_add(long double *sum, long double *comp, long double x)
+{
+	long double t = *sum + x;
+	*comp += fabsl(*sum) >= fabsl(x) ? (*sum - t) + x : (x - t) + *sum;
+	*sum = t;
+}
+
+static void whole_add(agg *a, uint64_t hi, uint64_t lo)
+{
+	a->lo += lo;
+	a->hi += hi + (a->lo < lo);
+}
+
+static size_t bucket_of(long double s)
+{
+	if (!s)
+		return 0;
+	double i = log(s / AGG_MIN) / log(AGG_GAMMA);
+	return i < 1 ? 1 : i >= AGG_BUCKETS-1 ? AGG_BUCKETS-1 : (size_t)i + 1;
+}
+
+static void agg_add(agg *a, long double s)
+{
+	a->n++;
+	if (s < a->min)
+		a->min = s;
+	if (s > a->max)
+		a->max = s;
+	if (s < 0x1p64L) {
+		long double whole = floorl(s);
+		whole_add(a, 0, whole);
+		sum_add(&a->rest, &a->comp, s - whole);
+	} else
+		sum_add(&a->rest, &a->comp, s);
+	a->buckets[bucket_of(s)]++;
+}
+
+/* Adds the values of src to dst, as if they'd all been added to it */
+static void agg_merge(agg *dst, const agg *src)
+{
+	dst->n += src->n, dst->bad += src->bad;
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	whole_add(dst, src->hi, src->lo);
+	sum_add(&dst->rest, &dst->comp, src->rest);
+	dst->comp += src->comp;
+	for (size_t i = 0; i < AGG_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+}
+
+static long double agg_sum(const agg *a)
+{
+	return a->hi*0x1p64L + a->lo + (a->rest + a->comp);
+}
+
+/* Estimate of the q thousandths quantile of a's values by nearest rank,
+ * the least value with at least q thousandths of them at or below it,
+ * as the middle of the bucket it's in, bounded by the exact min and max.
+ * a must have values.
+ */
+static long double agg_quantile(const agg *a, unsigned q)
+{
+	/* ceil(q*n / 1000) - 1, as an index, without overflowing */
+	unsigned long long n = a->n, seen = 0;
+	unsigned long long rank = n/1000*q + (n%1000*q + 999)/1000;
+	rank = rank ? rank-1 : 0;
+	size_t i = 0;
+	while ((seen += a->buckets[i]) <= rank)
+		i++;
+	long double s = i ? AGG_MIN * 2*pow(AGG_GAMMA, i) / (AGG_GAMMA+1) : 0;
+	return s < a->min ? a->min : s > a->max ? a->max : s;
+}
+
+/* Adds values of newline-delimited lines in [beg, end) to a */
+static void agg_lines(agg *a, const char *beg, const char *end)
+{
+	while (beg < end) {
+		const char *nl = memchr(beg, '\n', end-beg);
+		size_t n = (nl ? nl : end) - beg;
+		if (n && beg[n-1] == '\r')
+			n--;
+		if (n) {
+			long double s;
+			st_err err = STATS_ST(STAGE_NUM2S, st_num2s(beg, n, &s));
+			if (err == ST_EINVAL) /* May be in time units */
+				err = STATS_ST(STAGE_STR2S,
+					st_str2s(beg, n, 0, &s, NULL));
+			if (err)
+				a->bad++;
+			else
+				agg_add(a, s);
+		}
+		beg = nl ? nl+1 : end;
+	}
+}
+
+/* Adds values of lines of f to a, returning NULL or an error message */
+static const char *agg_file(agg *a, FILE *f)
+{
+	const char *err = NULL;
+	str in = str_create(BATCH_INBUF);
+	if (str_cap(&in) < BATCH_INBUF)
+		err = "Out of memory";
+	for (bool eof = false; !eof && !err;) {
+		char *end;
+		if (!(err = fill(&in, f, &eof, &end))) {
+			agg_lines(a, str_arr(&in), end);
+			consume(&in, end);
+		}
+	}
+	str_destroy(&in);
+	return err;
+}
+
+/* Files being aggregated by aggregate()'s workers, and what they've found */
+typedef struct agg_job {
+	char *const *paths;
+	size_t npaths, next; /* Files claimed by workers */
+	bool failed;
+	agg total;
+#ifdef HAVE_POSIX
+	pthread_mutex_t mtx;
+#endif
+} agg_job;
+
+#ifdef HAVE_POSIX
+#define JOB_LOCK(job)   pthread_mutex_lock(&(job)->mtx)
+#define JOB_UNLOCK(job) pthread_mutex_unlock(&(job)->mtx)
+#else
+#define JOB_LOCK(job)   ((void)0)
+#define JOB_UNLOCK(job) ((void)0)
+#endif
+
+/* Aggregates files of job until none are left, merging into its total */
+static void *agg_worker(void *arg)
+{
+	agg_job *job = arg;
+	agg *mine = malloc(sizeof(*mine));
+	if (!mine) {
+		JOB_LOCK(job);
+		job->failed = true;
+		JOB_UNLOCK(job);
+		fprintf(stderr, "Error: Out of memory.\n");
+		return NULL;
+	}
+	agg_init(mine);
+
+	for (;;) {
+		JOB_LOCK(job);
+		size_t k = job->next++;
+		bool done = k >= job->npaths || job->failed;
+		JOB_UNLOCK(job);
+		if (done)
+			break;
+
+		FILE *f = fopen(job->paths[k], "rb");
+		const char *err = f ? agg_file(mine, f) : "Couldn't open it";
+		if (f)
+			fclose(f);
+		if (err) {
+			fprintf(stderr, "Error: %s: %s.\n", job->paths[k], err);
+			JOB_LOCK(job);
+			job->failed = true;
+			JOB_UNLOCK(job);
+		}
+	}
+
+	JOB_LOCK(job);
+	agg_merge(&job->total, mine);
+	JOB_UNLOCK(job);
+	free(mine);
+	stats_merge();
+	return NULL;
+}
+
+/* Writes s in units of fmt as a line named name, without s2str()'s
+ * trailing space after a last unit that's 0.
+ */
+static void print_secs(const char *name, long double s, st_fmtflags fmt)
+{
+	char buf[ST_S2STR_MAX];
+	size_t n;
+	if (STATS_ST(STAGE_S2STR, st_s2str(s, fmt, buf, sizeof(buf), &n)))
+		n = 0, strcpy(buf, BAD_LINE);
+	while (n && buf[n-1] == ' ')
+		buf[--n] = '\0';
+	printf("%-6s %s\n", name, buf);
+}
+
+int aggregate(st_fmtflags fmt, char *const *paths, size_t npaths)
+{
+	agg_job *job = malloc(sizeof(*job));
+	if (!job) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return EXIT_FAILURE;
+	}
+	*job = (agg_job){.paths = paths, .npaths = npaths};
+	agg_init(&job->total);
+
+	if (!npaths) {
+		const char *err = agg_file(&job->total, stdin);
+		if (err) {
+			fprintf(stderr, "Error: %s.\n", err);
+			job->failed = true;
+		}
+	} else {
+#ifdef HAVE_POSIX
+		/* A thread per file, upto one per CPU */
+		pthread_mutex_init(&job->mtx, NULL);
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		size_t njobs = ncpus < 1 ? 1 : (size_t)ncpus;
+		if (njobs > npaths)
+			njobs = npaths;
+		pthread_t *workers = calloc(njobs, sizeof(*workers));
+		size_t nworkers = 0;
+		while (workers && nworkers < njobs && !pthread_create(
+				&workers[nworkers], NULL, agg_worker, job))
+			nworkers++;
+		while (nworkers)
+			pthread_join(workers[--nworkers], NULL);
+		free(workers);
+#endif
+		/* Any files left, if threads couldn't start */
+		agg_worker(job);
+#ifdef HAVE_POSIX
+		pthread_mutex_destroy(&job->mtx);
+#endif
+	}
+
+	fmt &= (1u << ST_NUNITS) - 1;
+	const agg *a = &job->total;
+	if (!job->failed) {
+		printf("%-6s %llu\n", "count", a->n);
+		if (a->n) {
+			long double sum = agg_sum(a);
+			print_secs("sum", sum, fmt);
+			print_secs("mean", sum / a->n, fmt);
+			print_secs("min", a->min, fmt);
+			for (size_t i = 0; i < sizeof(quantiles)/sizeof(*quantiles);
+					i++)
+				print_secs(quantiles[i].name,
+					agg_quantile(a, quantiles[i].q), fmt);
+			print_secs("max", a->max, fmt);
+		}
+		if (a->bad)
+			fprintf(stderr, "Error: Skipped %llu line%s that couldn't "
+				"be converted.\n", a->bad, a->bad == 1 ? "" : "s");
+		if (fflush(stdout)) {
+			fprintf(stderr, "Error: Couldn't write output.\n");
+			job->failed = true;
+		}
+	}
+	int ret = job->failed || a->bad ? EXIT_FAILURE : EXIT_SUCCESS;
+	free(job);
+	return ret;
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>  /* printf, fprintf, stdin, stderr */
+#include <stdlib.h> /* EXIT_SUCCESS, EXIT_FAILURE */
+#include <string.h> /* memchr, memcpy, strlen */
+
+#include "cli.h"
+
+/* Converts a duration of len chars, seconds or time in units, to units
+ * of fmt from date from, writing it to dst of ST_S2STR_MAX chars and
+ * its length to *n.
+ */
+static st_err convert_from(const char *time, size_t len, st_date from,
+		st_fmtflags fmt, char *dst, size_t *n)
+{
+	long double s;
+	st_err err = STATS_ST(STAGE_NUM2S, st_num2s(time, len, &s));
+	if (err == ST_EINVAL) /* May be in time units */
+		err = STATS_ST(STAGE_STR2S, st_str2s(time, len, 0, &s, NULL));
+	if (!err)
+		err = STATS_ST(STAGE_S2STR, st_s2str_anchored(s, from, fmt,
+			dst, ST_S2STR_MAX, n));
+	return err;
+}
+
+/* Converts lines of stdin to lines of stdout like batch() does, setting
+ * *allgood to false if any can't be. Returns NULL or an error message.
+ */
+static const char *anchored_lines(st_date from, st_fmtflags fmt,
+		bool *allgood)
+{
+	const char *err = NULL;
+	str in = str_create(BATCH_INBUF);
+	str out = str_create(BATCH_OUTBUF + ST_S2STR_MAX + 1);
+	if (str_cap(&in) < BATCH_INBUF
+			|| str_cap(&out) < BATCH_OUTBUF + ST_S2STR_MAX + 1)
+		err = "Out of memory";
+	for (bool eof = false; !eof && !err;) {
+		char *beg, *end;
+		if ((err = fill(&in, stdin, &eof, &end)))
+			break;
+		for (beg = str_arr(&in); beg < end;) {
+			char *nl = memchr(beg, '\n', end-beg);
+			size_t len = (nl ? nl : end) - beg, n;
+			if (len && beg[len-1] == '\r')
+				len--;
+			char *p = str_arr(&out)+out.len;
+			if (convert_from(beg, len, from, fmt, p, &n)) {
+				*allgood = false;
+				memcpy(p, BAD_LINE, n = sizeof(BAD_LINE)-1);
+			}
+			p[n++] = '\n';
+			out.len += n;
+			if (out.len >= BATCH_OUTBUF && !flush(&out)) {
+				err = "Couldn't write output";
+				break;
+			}
+			beg = nl ? nl+1 : end;
+		}
+		consume(&in, end);
+	}
+	if (!err && (!flush(&out) || fflush(stdout)))
+		err = "Couldn't write output";
+	str_destroy(&in), str_destroy(&out);
+	return err;
+}
+
+int anchored(const char *date, const char *time, st_fmtflags fmt)
+{
+	st_date from;
+	if (st_str2date(&from, date)) {
+		fprintf(stderr, "Error: Invalid date, expected YYYY-MM-DD.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!time) {
+		bool allgood = true;
+		const char *err = anchored_lines(from, fmt, &allgood);
+		if (err)
+			fprintf(stderr, "Error: %s.\n", err);
+		return allgood && !err ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	char buf[ST_S2STR_MAX];
+	size_t n;
+	st_err err = convert_from(time, strlen(time), from, fmt, buf, &n);
+	if (err) {
+		fprintf(stderr, "Error: %s.\n", err == ST_ERANGE
+			? "Argument out of range" : "Invalid argument");
+		return EXIT_FAILURE;
+	}
+	printf("%s\n", buf);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,886 @@
+/* Benchmarks for libsecondtime and the secondtime CLI.
+ *
+ * Usage : bench gen <seconds|units|fmts> <n> [seed]
+ *         bench run [path to secondtime]
+ *         bench compare <old.tsv> <new.tsv>
+ *         bench verify-parse [n] [seed]
+ *         bench verify-decompose [n] [seed]
+ *
+ * gen writes a reproducible corpus of n lines to stdout: seconds across
+ * magnitudes, unit strings of varying length, or all 128 format flag
+ * combinations (n is ignored). The same seed gives the same corpus.
+ *
+ * run measures each function on such corpora and the CLI end to end,
+ * including requests to it with --serve, --coproc or --shm against starting
+ * it for each, writing one tab-separated line per benchmark:
+ *
+ *     name  ns/op  allocs/op  ops
+ *
+ * compare prints old and new ns/op side by side for benchmarks in both
+ * files, marking those that got more than 5% slower.
+ *
+ * verify-parse checks st_num2s() against strtold() on n generated strings,
+ * a million by default, and st_str2s() on those without a suffix with one
+ * after it. verify-decompose checks every st_decompose() kernel the CPU
+ * has against the scalar one, and that against st_s2str(), on n values of
+ * seconds, 20000 by default, for every format. Both exit with
+ * EXIT_FAILURE on any mismatch.
+ */
+#define _DEFAULT_SOURCE /* clock_gettime, and syscall for ring.h */
+
+#include <stdio.h>  /* printf, fprintf, fopen, fgets, snprintf, FILE */
+#include <stdlib.h> /* malloc, realloc, free, strto*, system, EXIT_* */
+#include <string.h> /* strcmp, strlen, strchr, memcpy */
+#include <errno.h>  /* errno, ERANGE */
+#include <math.h>   /* signbit, isfinite, fabsl, nextafter, INFINITY, NAN */
+#include <float.h>  /* LDBL_EPSILON */
+#include <time.h>   /* clock_gettime, nanosleep, CLOCK_MONOTONIC */
+#include <signal.h> /* kill, SIGTERM */
+#include <unistd.h> /* fork, execl, pipe, dup2, read, write, getpid */
+#include <sys/socket.h> /* socket, connect */
+#include <sys/un.h>     /* struct sockaddr_un */
+#include <sys/wait.h>   /* waitpid */
+
+#include "../secondtime.h"
+#ifdef __linux__
+#include "../ring.h"
+#endif
+
+#include "../sbomga.h"
+SBOMGA_IMPL(str, realloc, free, 0, char)
+
+/* Strings of a value each, to compare their allocation strategies:
+ * on the heap, in a short buffer that fits common outputs like
+ * "2w 3d 8h 40m 12.5s", and in an arena reset after each batch.
+ */
+#define VALUE_SBO 48
+SBOMGA_IMPL(sbostr, realloc, free, VALUE_SBO, char)
+SBOMGA_ARENA_IMPL(arena, 1 << 16)
+SBOMGA_IMPL(arenastr, arena_realloc, arena_free, 0, char)
+#define VALUE_BATCH 1024
+
+/* Calls to malloc() or realloc() by sbomga so far */
+#define NALLOCS() (str_nallocs + sbostr_nallocs + arena_nblocks)
+
+/* splitmix64: small, fast and reproducible across platforms */
+static uint_least64_t rng_state;
+static uint_least64_t rng(void)
+{
+	uint_least64_t z = (rng_state += 0x9E3779B97F4A7C15u);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+	return (z ^ (z >> 31)) & 0xFFFFFFFFFFFFFFFFu;
+}
+/* Uniform in [0, 1) */
+static double rng01(void)
+{
+	return (rng() >> 11) * 0x1p-53;
+}
+
+/* Writes a random number of seconds, from 1ms to ~300 years, to dst */
+static int gen_seconds(char *dst, size_t cap)
+{
+	double s = (1 + 9*rng01());
+	for (int e = rng() % 14 - 3; e; e += e < 0 ? 1 : -1)
+		s = e < 0 ? s/10 : s*10;
+	return snprintf(dst, cap, rng() % 2 ? "%.6g" : "%.17g", s);
+}
+
+/* Writes random time in 1 to 7 units, largest first, to dst */
+static int gen_units(char *dst, size_t cap)
+{
+	int n = 0, nunits = 1 + rng() % ST_NUNITS;
+	for (int i = 0; i < ST_NUNITS; i++) {
+		/* Pick nunits of the remaining units */
+		if (rng() % (ST_NUNITS-i) >= (uint_least64_t)nunits)
+			continue;
+		nunits--;
+		unsigned x = rng() % 100;
+		n += rng() % 4 ? snprintf(dst+n, cap-n, "%u%c", x,
+				st_units[i].sfx)
+			: snprintf(dst+n, cap-n, "%u.%u%c", x,
+				(unsigned)(rng() % 1000), st_units[i].sfx);
+	}
+	return n;
+}
+
+/* Writes the suffixes of units set in fmt to dst */
+static int gen_fmt(char *dst, unsigned fmt)
+{
+	int n = 0;
+	for (int i = 0; i < ST_NUNITS; i++)
+		if (fmt & 1u << i)
+			dst[n++] = st_units[i].sfx;
+	dst[n] = '\0';
+	return n;
+}
+
+/* A corpus of NUL-separated lines */
+typedef struct corpus {
+	str text;
+	size_t n;
+} corpus;
+
+static bool corpus_make(corpus *c, const char *kind, size_t n,
+		uint_least64_t seed)
+{
+	char buf[128];
+	bool fmts = !strcmp(kind, "fmts");
+	if (fmts)
+		n = 128;
+	else if (strcmp(kind, "seconds") && strcmp(kind, "units"))
+		return false;
+
+	rng_state = seed;
+	*c = (corpus){0};
+	for (size_t i = 0; i < n; i++) {
+		int len = fmts ? gen_fmt(buf, i)
+			: *kind == 's' ? gen_seconds(buf, sizeof(buf))
+			: gen_units(buf, sizeof(buf));
+		if (!str_insert(&c->text, c->text.len, buf, len+1))
+			return false;
+	}
+	c->n = n;
+	return true;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/* Result of a benchmark, printed by report() */
+typedef struct result {
+	double ns_per_op, allocs_per_op;
+	size_t ops;
+} result;
+
+static void report(const char *name, result r)
+{
+	printf("%s\t%.2f\t%.4f\t%zu\n", name, r.ns_per_op, r.allocs_per_op,
+		r.ops);
+	fflush(stdout);
+}
+
+/* Keeps the compiler from optimising away benchmarked work */
+static volatile size_t sink;
+
+/* Runs body over every line of corpus c, with line and len set,
+ * repeating until at least 0.2s have passed, best of 3 runs.
+ */
+#define BENCH(name, c, body) do {                                           \
+	result best = {.ns_per_op = 1e300};                                 \
+	for (int run = 0; run < 3; run++) {                                 \
+		size_t ops = 0;                                             \
+		unsigned long a0 = NALLOCS();                               \
+		double t0 = now(), t;                                       \
+		do {                                                        \
+			const char *line = str_arr(&(c)->text);             \
+			for (size_t i_ = 0; i_ < (c)->n; i_++) {            \
+				size_t len = strlen(line);                  \
+				body;                                       \
+				line += len+1;                              \
+			}                                                   \
+			ops += (c)->n;                                      \
+		} while ((t = now()) - t0 < 0.2);                           \
+		double ns = (t-t0)*1e9 / ops;                               \
+		if (ns < best.ns_per_op)                                    \
+			best = (result){ns, (double)(NALLOCS()-a0)/ops, ops};\
+	}                                                                   \
+	report(name, best);                                                 \
+} while (0)
+
+/* Times the CLI converting corpus c with args, in bytes of input/sec */
+static bool bench_cli(const char *cli, const char *name, const corpus *c,
+		const char *args)
+{
+	char path[] = "/tmp/secondtime-bench-XXXXXX", cmd[512];
+	FILE *f = NULL;
+	int fd = mkstemp(path);
+	if (fd < 0 || !(f = fdopen(fd, "w")))
+		return false;
+
+	/* Turn NUL separators into newlines */
+	const char *p = str_arr(&c->text);
+	for (size_t i = 0; i < c->n; i++, p += strlen(p)+1)
+		fprintf(f, "%s\n", p);
+	size_t bytes = ftell(f);
+	fclose(f);
+
+	snprintf(cmd, sizeof(cmd), "%s %s < %s > /dev/null", cli, args, path);
+	result best = {.ns_per_op = 1e300};
+	bool ok = true;
+	for (int run = 0; run < 3 && ok; run++) {
+		double t0 = now();
+		ok = system(cmd) != -1;
+		double ns = (now()-t0)*1e9 / c->n;
+		if (ns < best.ns_per_op)
+			best = (result){ns, 0, c->n};
+	}
+	remove(path);
+	if (ok) {
+		report(name, best);
+		fprintf(stderr, "%s: %.1f MB/s\n", name,
+			bytes / (best.ns_per_op*c->n) * 1e3);
+	}
+	return ok;
+}
+
+/* Reads n response lines from fd, returning false on error */
+static bool read_responses(int fd, size_t n)
+{
+	char buf[65536];
+	while (n) {
+		ssize_t got = read(fd, buf, sizeof(buf));
+		if (got <= 0)
+			return false;
+		for (const char *p = buf; (p = memchr(p, '\n', buf+got - p)); p++)
+			n--;
+	}
+	return true;
+}
+
+/* Times conversions by a server started from cli, one request at a time
+ * and pipelined in batches, against starting cli for each conversion.
+ */
+static bool bench_serve(const char *cli, const corpus *c)
+{
+	enum { ROUNDTRIPS = 20000, DEPTH = 1000, EXECS = 200 };
+	struct sockaddr_un sa = {.sun_family = AF_UNIX};
+	snprintf(sa.sun_path, sizeof(sa.sun_path),
+		"/tmp/secondtime-bench-%ld.sock", (long)getpid());
+	pid_t pid = fork();
+	if (pid < 0)
+		return false;
+	else if (!pid) {
+		freopen("/dev/null", "w", stderr);
+		execl(cli, cli, "--serve", sa.sun_path, (char *)NULL);
+		_exit(127);
+	}
+
+	/* Wait upto a second for it to listen */
+	int fd = -1;
+	for (int tries = 0; fd < 0 && tries < 100; tries++) {
+		nanosleep(&(struct timespec){.tv_nsec = 10000000}, NULL);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd >= 0 && connect(fd, (struct sockaddr *)&sa, sizeof(sa)))
+			close(fd), fd = -1;
+	}
+
+	bool ok = fd >= 0;
+	const char *line = str_arr(&c->text);
+	size_t n = c->n < ROUNDTRIPS ? c->n : ROUNDTRIPS;
+	char req[160];
+	double t0 = now();
+	for (size_t i = 0; i < n && ok; i++, line += strlen(line)+1) {
+		int len = snprintf(req, sizeof(req), "%s\n", line);
+		ok = write(fd, req, len) == len && read_responses(fd, 1);
+	}
+	if (ok)
+		report("serve_roundtrip", (result){(now()-t0)*1e9 / n, 0, n});
+
+	str batch = {0};
+	line = str_arr(&c->text);
+	t0 = now();
+	for (size_t i = 0; i < c->n && ok; i += DEPTH) {
+		size_t k = c->n-i < DEPTH ? c->n-i : DEPTH;
+		batch.len = 0;
+		for (size_t j = 0; j < k && ok; j++, line += strlen(line)+1)
+			ok = str_insert(&batch, batch.len, line, strlen(line))
+				&& str_insert(&batch, batch.len, "\n", 1);
+		ok = ok && write(fd, str_arr(&batch), batch.len)
+				== (ssize_t)batch.len
+			&& read_responses(fd, k);
+	}
+	if (ok)
+		report("serve_pipelined", (result){(now()-t0)*1e9 / c->n, 0,
+			c->n});
+	str_destroy(&batch);
+	if (fd >= 0)
+		close(fd);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+
+	/* What serving saves: a process per conversion */
+	char cmd[512];
+	snprintf(cmd, sizeof(cmd), "%s 5400 > /dev/null", cli);
+	t0 = now();
+	for (int i = 0; i < EXECS && ok; i++)
+		ok = system(cmd) != -1;
+	if (ok)
+		report("cli_exec", (result){(now()-t0)*1e9 / EXECS, 0, EXECS});
+	return ok;
+}
+
+/* Times conversions by cli --coproc over pipes, one request at a time */
+static bool bench_coproc(const char *cli, const corpus *c)
+{
+	enum { ROUNDTRIPS = 20000 };
+	int to[2], from[2];
+	if (pipe(to))
+		return false;
+	else if (pipe(from)) {
+		close(to[0]), close(to[1]);
+		return false;
+	}
+	pid_t pid = fork();
+	if (!pid) {
+		dup2(to[0], STDIN_FILENO), dup2(from[1], STDOUT_FILENO);
+		close(to[0]), close(to[1]), close(from[0]), close(from[1]);
+		execl(cli, cli, "--coproc", (char *)NULL);
+		_exit(127);
+	}
+	close(to[0]), close(from[1]);
+
+	bool ok = pid > 0;
+	const char *line = str_arr(&c->text);
+	size_t n = c->n < ROUNDTRIPS ? c->n : ROUNDTRIPS;
+	char req[160];
+	double t0 = now();
+	for (size_t i = 0; i < n && ok; i++, line += strlen(line)+1) {
+		int len = snprintf(req, sizeof(req), "%s\n", line);
+		ok = write(to[1], req, len) == len && read_responses(from[0], 1);
+	}
+	if (ok)
+		report("coproc_roundtrip", (result){(now()-t0)*1e9 / n, 0, n});
+	close(to[1]), close(from[0]);
+	if (pid > 0)
+		waitpid(pid, NULL, 0);
+	return ok;
+}
+
+#ifdef __linux__
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/* Fills slot s of q with a request to format secs, and pushes it */
+static void request(ring *q, ring_slot *s, uint32_t id, double secs)
+{
+	s->id = id, s->op = RING_S2STR, s->flags = ST_FMT_ALL;
+	s->secs = secs;
+	ring_push(q);
+}
+
+/* Times conversions of n secs by cli --shm, one request at a time, and
+ * keeping its ring of requests full to compare with the batch path.
+ */
+static bool bench_shm(const char *cli, const double *secs, size_t n)
+{
+	enum { ROUNDTRIPS = 20000 };
+	char name[64];
+	snprintf(name, sizeof(name), "/secondtime-bench-%ld", (long)getpid());
+	pid_t pid = fork();
+	if (pid < 0)
+		return false;
+	else if (!pid) {
+		freopen("/dev/null", "w", stderr);
+		execl(cli, cli, "--shm", name, (char *)NULL);
+		_exit(127);
+	}
+
+	/* Wait upto a second for its region */
+	ring_region *r = NULL;
+	for (int tries = 0; !r && tries < 100; tries++) {
+		nanosleep(&(struct timespec){.tv_nsec = 10000000}, NULL);
+		r = ring_open(name);
+	}
+	ring_lane *l = r ? ring_attach(r) : NULL;
+	bool ok = l;
+	ring_slot *s;
+	static double lat[ROUNDTRIPS];
+	size_t m = n < ROUNDTRIPS ? n : ROUNDTRIPS;
+	double t0 = now();
+	for (size_t i = 0; i < m && ok; i++) {
+		double t = now();
+		if ((ok = (s = ring_claim_wait(&l->req, &r->stop))))
+			request(&l->req, s, i, secs[i]);
+		if ((ok = ok && (s = ring_peek_wait(&l->res, &r->stop)))) {
+			sink += s->len;
+			ring_pop(&l->res);
+		}
+		lat[i] = now() - t;
+	}
+	if (ok) {
+		report("shm_roundtrip", (result){(now()-t0)*1e9 / m, 0, m});
+		qsort(lat, m, sizeof(*lat), cmp_double);
+		fprintf(stderr, "shm_roundtrip: p50 %.2fus p99 %.2fus\n",
+			lat[m/2]*1e6, lat[m*99/100]*1e6);
+	}
+
+	t0 = now();
+	for (size_t sent = 0, got = 0; got < n && ok;) {
+		for (; sent < n && (s = ring_claim(&l->req)); sent++)
+			request(&l->req, s, sent, secs[sent]);
+		ok = (s = ring_peek_wait(&l->res, &r->stop));
+		for (; s; s = ring_peek(&l->res), got++) {
+			sink += s->len;
+			ring_pop(&l->res);
+		}
+	}
+	if (ok)
+		report("shm_pipelined", (result){(now()-t0)*1e9 / n, 0, n});
+
+	if (l)
+		ring_detach(l);
+	if (r)
+		ring_close(r);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return ok;
+}
+#endif
+
+static int run(const char *cli)
+{
+	enum { N = 100000, SEED = 42 };
+	corpus secs, units, fmts;
+	if (!corpus_make(&secs, "seconds", N, SEED)
+			|| !corpus_make(&units, "units", N, SEED)
+			|| !corpus_make(&fmts, "fmts", 0, SEED)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Parsed values of secs, for formatting benchmarks */
+	static long double vals[N];
+	static double dvals[N];
+	const char *line = str_arr(&secs.text);
+	for (size_t i = 0; i < N; i++, line += strlen(line)+1) {
+		st_num2s(line, strlen(line), &vals[i]);
+		dvals[i] = vals[i];
+	}
+
+	printf("benchmark\tns_per_op\tallocs_per_op\tops\n");
+	long double s;
+	size_t pos, n;
+	char buf[ST_S2STR_MAX];
+
+	BENCH("num2s", &secs, sink += !st_num2s(line, len, &s));
+	BENCH("str2s", &units, sink += !st_str2s(line, len, 0, &s, &pos));
+	BENCH("str2s_strict", &units,
+		sink += !st_str2s(line, len, ST_STRICT, &s, &pos));
+	st_fmtflags fmt;
+	BENCH("str2fmtflags", &fmts, sink += !st_str2fmtflags(&fmt, line));
+
+	/* Formatting: each fmtflags combination over every value */
+	size_t k = 0;
+	BENCH("ldtoa", &secs, (st_ldtoa(vals[i_], buf, sizeof(buf), &n),
+		sink += n));
+	BENCH("s2str_all", &secs, (st_s2str(vals[i_], ST_FMT_ALL,
+		buf, sizeof(buf), &n), sink += n));
+	BENCH("s2str_fmts", &secs, (st_s2str(vals[i_], (k++ % 127) + 1,
+		buf, sizeof(buf), &n), sink += n));
+	st_date from = {2024, 1, 31};
+	BENCH("s2str_anchored", &secs, (st_s2str_anchored(vals[i_], from,
+		ST_FMT_ALL, buf, sizeof(buf), &n), sink += n));
+
+	/* Appending results to a growing output buffer, as the CLI does,
+	 * to measure sbomga's growth policy.
+	 */
+	str out = {0};
+	BENCH("s2str_append", &secs, do {
+		if (out.len > (1 << 16))
+			out.len = 0;
+		if (str_reserve(&out, out.len + ST_S2STR_MAX)) {
+			st_s2str(vals[i_], ST_FMT_ALL, str_arr(&out)+out.len,
+				ST_S2STR_MAX, &n);
+			out.len += n;
+		}
+	} while (0));
+	str_destroy(&out);
+
+	/* A string per value, destroyed after use */
+#define VALUE(type, reset) do {                                             \
+	st_s2str(vals[i_], ST_FMT_ALL, buf, sizeof(buf), &n);               \
+	type v = type##_create(0);                                          \
+	if (type##_insert(&v, 0, buf, n))                                   \
+		sink += type##_arr(&v)[0];                                  \
+	type##_destroy(&v);                                                 \
+	if (i_ % VALUE_BATCH == VALUE_BATCH-1)                              \
+		reset;                                                      \
+} while (0)
+	BENCH("s2str_value_heap", &secs, VALUE(str, (void)0));
+	BENCH("s2str_value_sbo", &secs, VALUE(sbostr, (void)0));
+	BENCH("s2str_value_arena", &secs, VALUE(arenastr, arena_reset()));
+#undef VALUE
+	arena_release();
+
+	/* Bulk decomposition, per value */
+	static uint_least64_t counts[ST_NUNITS][N];
+	static double rem[N];
+	st_parts parts = {.rem = rem};
+	for (int i = 0; i < ST_NUNITS; i++)
+		parts.counts[i] = counts[i];
+	static const struct { const char *name; st_kernel k; } kernels[] = {
+		{"decompose_scalar", ST_KERNEL_SCALAR},
+		{"decompose_auto"  , ST_KERNEL_AUTO  }
+	};
+	for (size_t j = 0; j < sizeof(kernels)/sizeof(kernels[0]); j++) {
+		result best = {.ns_per_op = 1e300};
+		for (int r = 0; r < 3; r++) {
+			size_t ops = 0;
+			double t0 = now(), t;
+			do {
+				st_decompose(dvals, N, ST_FMT_ALL, &parts,
+					kernels[j].k);
+				ops += N;
+			} while ((t = now()) - t0 < 0.2);
+			double ns = (t-t0)*1e9 / ops;
+			if (ns < best.ns_per_op)
+				best = (result){ns, 0, ops};
+		}
+		report(kernels[j].name, best);
+	}
+
+	int ret = EXIT_SUCCESS;
+	if (cli && (!bench_cli(cli, "cli_batch_seconds", &secs, "-")
+			|| !bench_cli(cli, "cli_batch_units", &units, "-")
+			|| !bench_serve(cli, &secs)
+			|| !bench_coproc(cli, &secs))) {
+		fprintf(stderr, "Error: Couldn't run %s.\n", cli);
+		ret = EXIT_FAILURE;
+	}
+#ifdef __linux__
+	if (cli && !ret && !bench_shm(cli, dvals, N)) {
+		fprintf(stderr, "Error: Couldn't run %s --shm.\n", cli);
+		ret = EXIT_FAILURE;
+	}
+#endif
+	str_destroy(&secs.text), str_destroy(&units.text);
+	str_destroy(&fmts.text);
+	return ret;
+}
+
+/* Pieces of numbers, and what may be next to them, for gen_numberish() */
+static const char *const num_pieces[] = {
+	"0", "1", "5", "9", "00", "12345678901234567890", "999999999999999999",
+	"1844674407370955161", ".", "e", "E", "+", "-", " ", "\t", "x",
+	"0x1p3", "0xe", "0x1e5", "a", "p", "inf", "nan", "Infinity", "h", "s",
+	",", "0.1", "3.14159",
+	"e-", "e+", "e27", "e-27", "e28", "e-28", "e4932", "e-4950",
+	"e99999999999"
+};
+
+/* Writes a random string to dst of upto ST_NUM_MAX chars: digits around
+ * a point and an exponent, near the limits of parse_num()'s fast path,
+ * or pieces of numbers, so that most are numbers and many barely aren't.
+ */
+static int gen_numberish(char *dst)
+{
+	int n = 0;
+	if (rng() % 2) {
+		int nd = 1 + rng() % 24, pt = rng() % (nd+1);
+		for (int i = 0; i < nd; i++) {
+			if (i == pt)
+				dst[n++] = '.';
+			dst[n++] = '0' + rng() % 10;
+		}
+		if (rng() % 2)
+			n += sprintf(dst+n, "e%d", (int)(rng() % 80) - 40);
+	} else for (int np = 1 + rng() % 6; np; np--) {
+		const char *p = num_pieces[rng() % (sizeof(num_pieces)
+				/ sizeof(*num_pieces))];
+		size_t len = strlen(p);
+		if (n + len > ST_NUM_MAX)
+			break;
+		memcpy(dst+n, p, len), n += len;
+	}
+	dst[n] = '\0';
+	return n;
+}
+
+/* What st_num2s() should give for src of len chars, as strtold() reads
+ * it in the C locale.
+ */
+static st_err num2s_expected(const char *src, size_t len, long double *dst)
+{
+	char *end;
+	int olderrno = errno;
+	errno = 0;
+	long double x = strtold(src, &end);
+	int err = errno;
+	errno = olderrno;
+	if (end == src || (size_t)(end-src) != len)
+		return ST_EINVAL;
+	else if (signbit(x) || !isfinite(x) || err == ERANGE)
+		return ST_ERANGE;
+	*dst = x;
+	return ST_OK;
+}
+
+/* Whether st_str2s() should take src of len chars, a coefficient then
+ * the suffix of unit, as a term: if strtold() reads the coefficient up to
+ * the suffix and not into it, as it does hex digits, or there is none,
+ * and it's non-negative and finite in seconds, which it sets *dst to.
+ */
+static bool str2s_expected(const char *src, size_t len, int unit,
+		long double *dst)
+{
+	char *end;
+	int olderrno = errno;
+	errno = 0;
+	long double x = strtold(src, &end);
+	int err = errno;
+	errno = olderrno;
+	*dst = x * st_units[unit].secs;
+	return (size_t)(end-src) == len-1 && (end == src || (!signbit(x)
+		&& isfinite(*dst) && err != ERANGE));
+}
+
+/* Checks st_num2s() against strtold() on n generated strings, and
+ * st_str2s() on each without a suffix with one after it, writing those
+ * they disagree on to stderr. Returns EXIT_FAILURE if any.
+ */
+static int verify_parse(size_t n, uint_least64_t seed)
+{
+	char buf[ST_NUM_MAX+2], sfxs[ST_NUNITS+1] = {0};
+	unsigned long long bad = 0;
+	for (int u = 0; u < ST_NUNITS; u++)
+		sfxs[u] = st_units[u].sfx;
+	rng_state = seed;
+	for (size_t i = 0; i < n; i++) {
+		int len = gen_numberish(buf);
+		long double got = 0, want = 0;
+		st_err gerr = st_num2s(buf, len, &got);
+		st_err werr = num2s_expected(buf, len, &want);
+		if (gerr != werr || (!gerr && got != want)) {
+			if (bad++ < 10)
+				fprintf(stderr, "Mismatch: \"%s\" gave %d %La, "
+					"strtold() %d %La\n", buf, gerr, got,
+					werr, want);
+		}
+
+		/* Terms are summed in ns where exact, so may be off by
+		 * an ulp or so of x * secs
+		 */
+		int unit = rng() % ST_NUNITS;
+		if (strcspn(buf, sfxs) != (size_t)len)
+			continue;
+		buf[len++] = st_units[unit].sfx, buf[len] = '\0';
+		got = want = 0;
+		gerr = st_str2s(buf, len, 0, &got, NULL);
+		bool wok = str2s_expected(buf, len, unit, &want);
+		if (!gerr != wok || (wok && fabsl(got - want)
+				> 4*LDBL_EPSILON * want)) {
+			if (bad++ < 10)
+				fprintf(stderr, "Mismatch: \"%s\" gave %d %La, "
+					"strtold() %s %La\n", buf, gerr, got,
+					wok ? "takes" : "rejects", want);
+		}
+	}
+	printf("verify-parse\t%zu strings\t%llu mismatches\n", n, bad);
+	return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* Checks that parts[k] of fmt match what st_s2str() writes for v: the
+ * same counts of every unit but the last, and the remainder to the
+ * digits written, or to the nanosecond st_s2str() may round it to.
+ */
+static bool parts_match_s2str(double v, st_fmtflags fmt, const st_parts *p,
+		size_t k, int last)
+{
+	char buf[ST_S2STR_MAX], *q = buf;
+	if (st_s2str(v, fmt, buf, sizeof(buf), NULL))
+		return false;
+	uint_least64_t counts[ST_NUNITS] = {0};
+	long double rem = 0;
+	while (*q) {
+		char *end;
+		long double x = strtold(q, &end);
+		int i = 0;
+		while (i < ST_NUNITS && st_units[i].sfx != *end)
+			i++;
+		if (end == q || i == ST_NUNITS)
+			return false;
+		if (i == last)
+			rem = x;
+		else
+			counts[i] = x;
+		for (q = end+1; *q == ' '; q++)
+			;
+	}
+	for (int i = 0; i < last; i++)
+		if (fmt >> i & 1 && counts[i] != p->counts[i][k])
+			return false;
+	return fabsl(rem - p->rem[k]) * st_units[last].secs
+		<= (1e-5L * p->rem[k]) * st_units[last].secs + 1e-9L;
+}
+
+/* Checks every st_decompose() kernel the CPU has against ST_KERNEL_SCALAR
+ * bit for bit, and that against st_s2str(), for every format on n values
+ * of seconds from the bench corpus, values next to whole units, and
+ * values that must fall back to the scalar path. Writes mismatches to
+ * stderr, returning EXIT_FAILURE if any.
+ */
+static int verify_decompose(size_t n, uint_least64_t seed)
+{
+	static const double special[] = {
+		0, -0.0, -1, 1e-300, 0x1p52, 0x1p52 + 1, 0x1p64, 1e20, 1e300,
+		INFINITY, -INFINITY, NAN
+	};
+	const size_t nspecial = sizeof(special)/sizeof(*special);
+	struct { const char *name; st_kernel k; } kernels[3] = {
+		{"auto", ST_KERNEL_AUTO}
+	};
+	size_t nkernels = 1;
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		kernels[nkernels++].name = "sse2",
+		kernels[nkernels-1].k = ST_KERNEL_SSE2;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		kernels[nkernels++].name = "avx2",
+		kernels[nkernels-1].k = ST_KERNEL_AVX2;
+#endif
+
+	corpus secs;
+	const size_t total = n + n/2 + nspecial;
+	double *v = malloc(total * sizeof(*v));
+	uint_least64_t *mem = malloc(2*ST_NUNITS * total * sizeof(*mem));
+	double *rems = malloc(2*total * sizeof(*rems));
+	if (!v || !mem || !rems || !corpus_make(&secs, "seconds", n, seed)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return EXIT_FAILURE;
+	}
+	const char *line = str_arr(&secs.text);
+	size_t m = 0;
+	for (; m < n; m++, line += strlen(line)+1)
+		v[m] = strtod(line, NULL);
+	/* Whole numbers of a unit, and the doubles either side of them */
+	while (m+3 <= n + n/2) {
+		double w = (double)(rng() % 1000000)
+			* (double)st_units[rng() % ST_NUNITS].secs;
+		v[m++] = w, v[m++] = nextafter(w, 0), v[m++] = nextafter(w, 1e308);
+	}
+	memcpy(v+m, special, sizeof(special));
+	m += nspecial;
+
+	st_parts ref = {.rem = rems}, got = {.rem = rems + total};
+	for (int i = 0; i < ST_NUNITS; i++)
+		ref.counts[i] = mem + i*total,
+		got.counts[i] = mem + (ST_NUNITS+i)*total;
+
+	unsigned long long bad = 0;
+	for (unsigned fmt = 1; fmt < 1u << ST_NUNITS; fmt++) {
+		int last = ST_NUNITS-1;
+		while (!(fmt >> last & 1))
+			last--;
+		st_err rerr = st_decompose(v, m, fmt, &ref, ST_KERNEL_SCALAR);
+		for (size_t j = 0; j < nkernels; j++) {
+			st_err gerr = st_decompose(v, m, fmt, &got, kernels[j].k);
+			for (size_t k = 0; k < m; k++) {
+				bool same = gerr == rerr && !memcmp(&got.rem[k],
+					&ref.rem[k], sizeof(double));
+				for (int i = 0; i < last; i++)
+					same &= !(fmt >> i & 1) || got.counts[i][k]
+						== ref.counts[i][k];
+				if (!same && bad++ < 10)
+					fprintf(stderr, "Mismatch: %s kernel on %.17g "
+						"with format %#x\n", kernels[j].name,
+						v[k], fmt);
+			}
+		}
+		/* Only where the scalar kernel converts every value */
+		for (size_t k = 0; k < m; k++)
+			if (!signbit(v[k]) && v[k] < 0x1p52
+					&& !parts_match_s2str(v[k], fmt, &ref, k, last)
+					&& bad++ < 10)
+				fprintf(stderr, "Mismatch: st_s2str() on %.17g "
+					"with format %#x\n", v[k], fmt);
+	}
+	printf("verify-decompose\t%zu values\t%zu kernels\t%llu mismatches\n",
+		m, nkernels, bad);
+	free(v), free(mem), free(rems);
+	str_destroy(&secs.text);
+	return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* Looks up name's ns/op in a results file, returning < 0 if absent */
+static double lookup(FILE *f, const char *name)
+{
+	char line[256];
+	rewind(f);
+	while (fgets(line, sizeof(line), f)) {
+		char *tab = strchr(line, '\t');
+		if (tab && (size_t)(tab-line) == strlen(name)
+				&& !strncmp(line, name, tab-line))
+			return strtod(tab+1, NULL);
+	}
+	return -1;
+}
+
+static int compare(const char *oldpath, const char *newpath)
+{
+	FILE *o = fopen(oldpath, "r"), *n = fopen(newpath, "r");
+	if (!o || !n) {
+		fprintf(stderr, "Error: Couldn't open results.\n");
+		return EXIT_FAILURE;
+	}
+	char line[256];
+	printf("%-20s %12s %12s %8s\n", "benchmark", "old ns/op", "new ns/op",
+		"speedup");
+	fgets(line, sizeof(line), n); /* Header */
+	while (fgets(line, sizeof(line), n)) {
+		char *tab = strchr(line, '\t');
+		if (!tab)
+			continue;
+		*tab = '\0';
+		double nv = strtod(tab+1, NULL), ov = lookup(o, line);
+		if (ov < 0)
+			continue;
+		printf("%-20s %12.2f %12.2f %7.2fx%s\n", line, ov, nv, ov/nv,
+			nv > ov*1.05 ? "  SLOWER" : "");
+	}
+	fclose(o), fclose(n);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc >= 4 && argc <= 5 && !strcmp(argv[1], "gen")) {
+		corpus c;
+		char *e;
+		uint_least64_t seed = argc == 5 ? strtoul(argv[4], &e, 10) : 42;
+		if (!corpus_make(&c, argv[2], strtoul(argv[3], &e, 10), seed)) {
+			fprintf(stderr, "Error: Invalid corpus or out of memory.\n");
+			return EXIT_FAILURE;
+		}
+		const char *p = str_arr(&c.text);
+		for (size_t i = 0; i < c.n; i++, p += strlen(p)+1)
+			puts(p);
+		str_destroy(&c.text);
+		return EXIT_SUCCESS;
+	} else if (argc >= 2 && argc <= 3 && !strcmp(argv[1], "run"))
+		return run(argv[2]);
+	else if (argc == 4 && !strcmp(argv[1], "compare"))
+		return compare(argv[2], argv[3]);
+	else if (argc >= 2 && argc <= 4 && !strcmp(argv[1], "verify-parse")) {
+		char *e = "";
+		size_t n = argc >= 3 ? strtoul(argv[2], &e, 10) : 1000000;
+		uint_least64_t seed = argc == 4 ? strtoul(argv[3], &e, 10) : 42;
+		if (!*e)
+			return verify_parse(n, seed);
+	}
+	else if (argc >= 2 && argc <= 4
+			&& !strcmp(argv[1], "verify-decompose")) {
+		char *e = "";
+		size_t n = argc >= 3 ? strtoul(argv[2], &e, 10) : 20000;
+		uint_least64_t seed = argc == 4 ? strtoul(argv[3], &e, 10) : 42;
+		if (!*e && n)
+			return verify_decompose(n, seed);
+	}
+
+	fprintf(stderr,
+	"Usage : %s gen <seconds|units|fmts> <n> [seed]\n"
+	"        %s run [path to secondtime]\n"
+	"        %s compare <old.tsv> <new.tsv>\n"
+	"        %s verify-parse [n] [seed]\n"
+	"        %s verify-decompose [n] [seed]\n", argv[0], argv[0], argv[0],
+	argv[0], argv[0]);
+	return EXIT_FAILURE;
+}
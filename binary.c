@@ -0,0 +1,174 @@
+#include <stdio.h>  /* fread, fwrite, fprintf, stdin, stdout, stderr */
+#include <stdlib.h> /* EXIT_SUCCESS, EXIT_FAILURE */
+#include <string.h> /* memcpy, memmove */
+#include <stdint.h> /* uint64_t, int64_t */
+
+#include "cli.h"
+
+/* Records converted at a time, in blocks of 64 KiB of input */
+#define BIN_BLOCK 8192
+
+/* Input record and packed output sizes, see binary() */
+#define BIN_RECORD   8
+#define BIN_HEADER   16
+#define BIN_VERSION  1
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LITTLE_ENDIAN_HOST 1
+#endif
+
+static uint64_t load_le64(const unsigned char *p)
+{
+	uint64_t x = 0;
+#ifdef LITTLE_ENDIAN_HOST
+	memcpy(&x, p, sizeof(x));
+#else
+	for (int i = 7; i >= 0; i--)
+		x = x << 8 | p[i];
+#endif
+	return x;
+}
+
+static void store_le64(unsigned char *p, uint64_t x)
+{
+#ifdef LITTLE_ENDIAN_HOST
+	memcpy(p, &x, sizeof(x));
+#else
+	for (int i = 0; i < 8; i++)
+		p[i] = x >> 8*i & 0xFF;
+#endif
+}
+
+static double bits2f64(uint64_t x)
+{
+	double d;
+	memcpy(&d, &x, sizeof(d));
+	return d;
+}
+
+static uint64_t f642bits(double d)
+{
+	uint64_t x;
+	memcpy(&x, &d, sizeof(x));
+	return x;
+}
+
+/* Writes the header of packed output, returning false on error */
+static bool write_header(st_fmtflags fmt, size_t recsize)
+{
+	unsigned char h[BIN_HEADER] = {'S', 'T', 'P', 'K', BIN_VERSION, fmt,
+		recsize & 0xFF, recsize >> 8};
+	store_le64(h+8, f642bits(st_units[0].secs));
+	return fwrite(h, 1, sizeof(h), stdout) == sizeof(h);
+}
+
+int binary(bin_type type, bool packed, st_fmtflags fmt)
+{
+	const char *err = NULL;
+	bool allgood = true;
+
+	/* Units of packed records, and the size of each */
+	st_fmtflags ufmt = fmt & ((1u << ST_NUNITS) - 1);
+	uint_fast8_t sel[ST_NUNITS], nsel = 0;
+	for (uint_fast8_t i = 0; i < ST_NUNITS; i++)
+		if (ufmt >> i & 1)
+			sel[nsel++] = i;
+	const size_t recsize = nsel*8;
+
+	static unsigned char in[BIN_BLOCK*BIN_RECORD];
+	static double secs[BIN_BLOCK], rem[BIN_BLOCK];
+	static uint_least64_t counts[ST_NUNITS][BIN_BLOCK];
+	st_parts parts = {.rem = rem};
+	for (uint_fast8_t i = 0; i < ST_NUNITS; i++)
+		parts.counts[i] = counts[i];
+
+	const size_t outcap = packed ? BIN_BLOCK*recsize
+		: BATCH_OUTBUF + ST_S2STR_MAX;
+	str out = str_create(outcap);
+	if (str_cap(&out) < outcap) {
+		err = "Out of memory";
+		goto end;
+	}
+	if (packed && !write_header(ufmt, recsize)) {
+		err = "Couldn't write output";
+		goto end;
+	}
+
+	size_t have = 0; /* Bytes of an incomplete record left over */
+	for (bool eof = false; !eof;) {
+		size_t want = BIN_BLOCK*BIN_RECORD - have;
+		STATS_BEGIN();
+		size_t got = fread(in+have, 1, want, stdin);
+		STATS_END(STAGE_READ, got < want && ferror(stdin));
+		if (got < want) {
+			if (ferror(stdin)) {
+				err = "Couldn't read input";
+				goto end;
+			}
+			eof = true;
+		}
+		have += got;
+		size_t n = have / BIN_RECORD;
+
+		/* Decode records to seconds */
+		for (size_t k = 0; k < n; k++) {
+			uint64_t x = load_le64(in + k*BIN_RECORD);
+			if (type == BIN_F64)
+				secs[k] = bits2f64(x);
+			else { /* Whole seconds convert exactly, split them off */
+				int64_t ns = (int64_t)x;
+				secs[k] = ns < 0 ? -1
+					: (double)(ns / 1000000000)
+					+ (double)(ns % 1000000000) / 1e9;
+			}
+		}
+
+		if (packed) {
+			allgood &= !STATS_ST(STAGE_DECOMPOSE,
+				st_decompose(secs, n, ufmt, &parts, ST_KERNEL_AUTO));
+			unsigned char *p = (unsigned char *)str_arr(&out);
+			for (size_t k = 0; k < n; k++, p += recsize) {
+				for (uint_fast8_t j = 0; j+1 < nsel; j++)
+					store_le64(p + j*8, counts[sel[j]][k]);
+				store_le64(p + (nsel-1)*8, f642bits(rem[k]));
+			}
+			out.len = p - (unsigned char *)str_arr(&out);
+			if (!flush(&out)) {
+				err = "Couldn't write output";
+				goto end;
+			}
+		} else for (size_t k = 0; k < n; k++) {
+			long double s = secs[k];
+			if (type == BIN_NS) { /* More precise than secs[k] */
+				int64_t ns = load_le64(in + k*BIN_RECORD);
+				s = ns / 1e9L;
+			}
+			size_t len;
+			if (STATS_ST(STAGE_S2STR, st_s2str(s, fmt,
+					str_arr(&out)+out.len, ST_S2STR_MAX, &len))) {
+				allgood = false;
+				memcpy(str_arr(&out)+out.len, BAD_LINE,
+					len = sizeof(BAD_LINE)-1);
+			}
+			str_arr(&out)[out.len + len++] = '\n';
+			out.len += len;
+			if (out.len >= BATCH_OUTBUF && !flush(&out)) {
+				err = "Couldn't write output";
+				goto end;
+			}
+		}
+
+		/* Keep any incomplete record for the next block */
+		have -= n*BIN_RECORD;
+		memmove(in, in + n*BIN_RECORD, have);
+	}
+	if (!flush(&out) || fflush(stdout))
+		err = "Couldn't write output";
+	else if (have)
+		err = "Input ends in an incomplete record";
+end:
+	if (err)
+		fprintf(stderr, "Error: %s.\n", err);
+	str_destroy(&out);
+	return allgood && !err ? EXIT_SUCCESS : EXIT_FAILURE;
+}
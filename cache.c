@@ -0,0 +1,120 @@
+#include <stdint.h> /* uint64_t, uint32_t */
+#include <stdlib.h> /* calloc, free      */
+#include <string.h> /* memcmp, memcpy    */
+
+#include "cache.h"
+
+#define WAYS 4
+
+/* Entry.state */
+enum { EMPTY, GOOD, BAD };
+
+typedef struct entry {
+	uint64_t hash;
+	uint32_t used; /* Value of cache.tick when last looked up */
+	unsigned char klen, vlen, fmt, state;
+	char key[CACHE_KEY_MAX], val[CACHE_VAL_MAX];
+} entry;
+_Static_assert(sizeof(entry) == CACHE_ENTRY_SIZE, "entry isn't packed");
+
+struct cache {
+	entry *sets; /* WAYS entries per set */
+	size_t mask; /* Number of sets - 1 */
+	uint32_t tick;
+	unsigned long long hits, misses;
+};
+
+cache *cache_create(size_t n)
+{
+	size_t nsets = 1;
+	while (nsets*WAYS < n && nsets <= SIZE_MAX/2/WAYS/sizeof(entry))
+		nsets *= 2;
+
+	cache *c = calloc(1, sizeof(*c));
+	if (c && !(c->sets = calloc(nsets*WAYS, sizeof(entry)))) {
+		free(c);
+		return NULL;
+	}
+	if (c)
+		c->mask = nsets-1;
+	return c;
+}
+
+void cache_destroy(cache *c)
+{
+	if (c)
+		free(c->sets), free(c);
+}
+
+/* FNV-1a of key, with fmt mixed in */
+static uint64_t hash(const char *key, size_t klen, st_fmtflags fmt)
+{
+	uint64_t h = 0xcbf29ce484222325u ^ fmt;
+	while (klen--)
+		h = (h ^ (unsigned char)*key++) * 0x100000001b3u;
+	return h;
+}
+
+static entry *set_of(const cache *c, uint64_t h)
+{
+	return c->sets + ((h ^ h>>32) & c->mask)*WAYS;
+}
+
+cache_res cache_get(cache *c, const char *key, size_t klen,
+		st_fmtflags fmt, char *dst, size_t *len)
+{
+	if (klen <= CACHE_KEY_MAX) {
+		uint64_t h = hash(key, klen, fmt);
+		entry *set = set_of(c, h);
+		for (entry *e = set; e < set+WAYS; e++)
+			if (e->state != EMPTY && e->hash == h && e->fmt == fmt
+					&& e->klen == klen
+					&& !memcmp(e->key, key, klen)) {
+				e->used = ++c->tick;
+				c->hits++;
+				if (e->state == BAD)
+					return CACHE_HIT_BAD;
+				memcpy(dst, e->val, e->vlen);
+				*len = e->vlen;
+				return CACHE_HIT;
+			}
+	}
+	c->misses++;
+	return CACHE_MISS;
+}
+
+void cache_put(cache *c, const char *key, size_t klen,
+		st_fmtflags fmt, const char *val, size_t vlen)
+{
+	if (klen > CACHE_KEY_MAX || (val && vlen > CACHE_VAL_MAX))
+		return;
+
+	/* Take an empty entry, else the one unused for longest */
+	uint64_t h = hash(key, klen, fmt);
+	entry *set = set_of(c, h), *victim = set;
+	for (entry *e = set; e < set+WAYS; e++) {
+		if (e->state == EMPTY) {
+			victim = e;
+			break;
+		} else if ((uint32_t)(c->tick - e->used)
+				> (uint32_t)(c->tick - victim->used))
+			victim = e;
+	}
+	*victim = (entry){
+		.hash = h, .used = ++c->tick, .klen = klen, .fmt = fmt,
+		.state = val ? GOOD : BAD
+	};
+	memcpy(victim->key, key, klen);
+	if (val)
+		memcpy(victim->val, val, vlen), victim->vlen = vlen;
+}
+
+unsigned long long cache_hits(const cache *c)
+{
+	return c->hits;
+}
+
+unsigned long long cache_misses(const cache *c)
+{
+	return c->misses;
+}
@@ -0,0 +1,57 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h> /* bool   */
+#include <stddef.h>  /* size_t */
+
+#include "secondtime.h" /* st_fmtflags */
+
+/* A bounded cache of conversions, keyed by the raw input token and the
+ * format it was converted to, so that repeated tokens skip conversion.
+ *
+ * It is 4-way set associative with least recently used eviction within
+ * each set, so memory use is fixed at creation whatever the input.
+ * Tokens or results too long to fit an entry are never cached.
+ *
+ * A cache must be used by only one thread at a time.
+ */
+typedef struct cache cache;
+
+/* Longest token and result an entry can hold */
+#define CACHE_KEY_MAX 36
+#define CACHE_VAL_MAX 76
+
+/* Bytes of memory used per entry of capacity */
+#define CACHE_ENTRY_SIZE 128
+
+/* Results of cache_get() */
+typedef enum cache_res {
+	CACHE_MISS,
+	CACHE_HIT,
+	CACHE_HIT_BAD /* Token is known to be unconvertible */
+} cache_res;
+
+/* Returns a new cache of at least n entries, or NULL if out of memory */
+cache *cache_create(size_t n);
+void cache_destroy(cache *c);
+
+/* Looks up key of klen chars converted with fmt.
+ *
+ * On CACHE_HIT, the result is copied to dst, which must have room for
+ * CACHE_VAL_MAX chars, and its length stored in *len.
+ */
+cache_res cache_get(cache *c, const char *key, size_t klen,
+		st_fmtflags fmt, char *dst, size_t *len);
+
+/* Remembers val of vlen chars as the result of converting key of klen
+ * chars with fmt, or if val is NULL, that it can't be converted,
+ * evicting the least recently used entry of its set if needed.
+ */
+void cache_put(cache *c, const char *key, size_t klen,
+		st_fmtflags fmt, const char *val, size_t vlen);
+
+/* Number of lookups that hit or missed since creation */
+unsigned long long cache_hits(const cache *c);
+unsigned long long cache_misses(const cache *c);
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef CLI_H
+#define CLI_H
+
+/* Shared by the modes of the secondtime CLI, which live in their own files */
+
+#include <stdbool.h> /* bool */
+#include <stdio.h>   /* FILE */
+
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#define HAVE_POSIX 1
+#endif
+
+#include "stats.h" /* STATS_*, for --stats */
+
+#include "sbomga.h" /* github.com/a-p-jo/darc/blob/main/sbomga/sbomga.h */
+SBOMGA_IMPL(str, STATS_REALLOC, free, 0, char) /* Dynamic SSO string */
+
+#include "secondtime.h" /* st_* */
+#include "cache.h"      /* cache */
+
+/* Written in place of the result for lines that couldn't be converted */
+#define BAD_LINE "?"
+
+/* Flush output buffer once it grows past this many bytes */
+#define BATCH_OUTBUF 65536
+/* Read input in blocks of at least this many bytes */
+#define BATCH_INBUF  65536
+
+/* Results of convert_args() */
+typedef enum args_res {
+	ARGS_OK,
+	ARGS_ERR, /* Conversion failed */
+	ARGS_BAD  /* Incorrect arguments */
+} args_res;
+
+/* Chars convert_args() may write, including the NUL */
+#define ARGS_MAX ST_S2STR_MAX
+
+/* Converts time of len chars and format fmt, or NULL for deffmt,
+ * like main() converts argv[1] and argv[2], writing the result
+ * or on ARGS_ERR, an error message, as a cstring to dst.
+ */
+args_res convert_args(const char *time, size_t len, const char *fmt,
+		st_fmtflags deffmt, char *dst);
+
+/* Converts newline-delimited lines in [beg, end) into dst like batch()
+ * does, tolerating CRLF line endings, setting *allgood to false if any
+ * can't be. memo may be NULL to not cache conversions.
+ * Returns false only for reallocation errors.
+ */
+bool convert_lines(const char *beg, const char *end, st_fmtflags fmt,
+		cache *memo, str *dst, bool *allgood);
+
+/* Writes cache hits and misses of n caches of memos to stderr */
+void report_cache(cache *const *memos, size_t n);
+
+/* Writes all of buf to stdout and clears it, returning false on error */
+bool flush(str *buf);
+
+/* Reads a block of f into in, after any incomplete line it holds,
+ * setting *eof at the end of input and *end past the last complete line
+ * read, or past all of in at EOF.
+ *
+ * Returns NULL or an error message.
+ */
+const char *fill(str *in, FILE *f, bool *eof, char **end);
+
+/* Drops lines before end from in, moving the incomplete line after them
+ * to the front for the next fill().
+ */
+void consume(str *in, const char *end);
+
+/* Types of binary()'s input records */
+typedef enum bin_type {
+	BIN_F64, /* float64 seconds      */
+	BIN_NS   /* int64 nanoseconds    */
+} bin_type;
+
+/* Converts packed little-endian records of type on stdin to lines of time
+ * in units on stdout like batch() does, or if packed, to packed records of
+ * the counts of units selected by fmt. The packed format is versioned and
+ * documented in README.md. fmt must select at least one unit.
+ *
+ * Returns EXIT_SUCCESS if every value was converted, else EXIT_FAILURE.
+ */
+int binary(bin_type type, bool packed, st_fmtflags fmt);
+
+/* Aggregates values of time, one per line like batch() reads them, from
+ * each of the npaths files at paths, or stdin if npaths is 0. Writes
+ * their count, exact sum, mean, min, max and quantiles to stdout, in
+ * units selected by fmt. Files are read in parallel, and the partial
+ * aggregates of each merged. Empty lines are skipped.
+ *
+ * Returns EXIT_SUCCESS if every value was read, else EXIT_FAILURE.
+ */
+int aggregate(st_fmtflags fmt, char *const *paths, size_t npaths);
+
+/* Converts time, seconds or time in units, like main() converts seconds,
+ * but as a duration from 00:00 of date, as YYYY-MM-DD, in calendar years
+ * and months, with st_s2str_anchored(). If time is NULL, converts lines
+ * of stdin like batch() does.
+ *
+ * Returns EXIT_SUCCESS if every value was converted, else EXIT_FAILURE.
+ */
+int anchored(const char *date, const char *time, st_fmtflags fmt);
+
+/* Sorts lines of time, seconds or time in units, of the file at path, or
+ * stdin if path is "-", by their seconds, keeping lines of equal seconds
+ * in order, to stdout. Writes lines as they were, or if reformat, their
+ * seconds in units selected by fmt. Each line's seconds are read once,
+ * and lines are sorted as offsets into the file, mapped if it's regular,
+ * with a radix sort of keys that order as the seconds do. Input larger
+ * than about budget bytes is sorted in runs spilled to temporary files,
+ * then merged. Lines that can't be converted are sorted last.
+ *
+ * Returns EXIT_SUCCESS if every line was converted, else EXIT_FAILURE.
+ */
+int sort_lines(const char *path, size_t budget, st_fmtflags fmt,
+		bool reformat);
+
+/* Converts lines of each of the npaths files at paths like batch() does,
+ * into a file of the same path with ".out" appended. Reads of the next
+ * block and writes of the last overlap conversion, with io_uring where
+ * the kernel has it, else with pread() and pwrite(). If cachecap isn't 0,
+ * conversions are cached like batch() does. Writes the throughput of
+ * each file and of all to stderr.
+ *
+ * Returns EXIT_SUCCESS if every line of every file was converted,
+ * else EXIT_FAILURE.
+ */
+int files(st_fmtflags fmt, char *const *paths, size_t npaths,
+		size_t cachecap);
+
+/* Serves conversions to clients of the Unix domain socket at path, until
+ * SIGINT or SIGTERM, then writes latency percentiles to stderr.
+ *
+ * Each request is a line of a time and optional format, separated by
+ * spaces, converted like convert_args() does. Each response is a line of
+ * "OK " and the result or "ERR " and an error message, in order.
+ * A request of ":format [format]" sets the format of later requests
+ * without one, and is answered with "OK " and its units.
+ *
+ * Returns EXIT_SUCCESS, or EXIT_FAILURE if it couldn't start.
+ */
+int serve(const char *path);
+
+/* Most lanes of shm_serve() */
+#define SHM_MAXLANES 256
+
+/* Serves conversions to processes on this host through a region of shared
+ * memory named name with nlanes lanes of lock-free rings, laid out in
+ * ring.h, and a worker thread per lane, until SIGINT or SIGTERM. Then
+ * writes how many requests were answered to stderr.
+ *
+ * Returns EXIT_SUCCESS, or EXIT_FAILURE if it couldn't start.
+ */
+int shm_serve(const char *name, size_t nlanes);
+
+/* Serves requests like serve() does, read from stdin, with fmt as the
+ * format until changed. Responses are written as soon as the requests
+ * read so far are answered, so a caller may write a request and wait
+ * for its response.
+ *
+ * Returns EXIT_SUCCESS, or EXIT_FAILURE on errors.
+ */
+int coproc(st_fmtflags fmt);
+
+/* Sends time and fmt, which may be NULL, to the server at path,
+ * writing the result to stdout or an error to stderr like main().
+ *
+ * Returns EXIT_SUCCESS if the conversion succeeded, else EXIT_FAILURE.
+ */
+int client(const char *path, const char *time, const char *fmt);
+
+#endif
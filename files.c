@@ -0,0 +1,402 @@
+#define _DEFAULT_SOURCE /* pread, pwrite */
+
+#include <stdio.h>  /* fprintf, stderr */
+#include <stdlib.h> /* EXIT_SUCCESS, EXIT_FAILURE, malloc, free */
+#include <string.h> /* memchr, memcpy, strlen */
+
+#include "cli.h"
+
+#ifdef HAVE_POSIX
+#include <errno.h>    /* errno, EINTR */
+#include <fcntl.h>    /* open, O_* */
+#include <time.h>     /* clock_gettime, CLOCK_MONOTONIC */
+#include <unistd.h>   /* pread, pwrite, close */
+#include <sys/uio.h>  /* struct iovec */
+#ifdef __linux__
+#include <linux/io_uring.h> /* io_uring_*, IORING_* */
+#include <sys/mman.h>       /* mmap, munmap */
+#include <sys/syscall.h>    /* SYS_io_uring_setup, SYS_io_uring_enter */
+#endif
+
+/* Bytes of input read at a time, into each of two buffers */
+#define FILES_BLOCK (1 << 20)
+/* Suffix of the output file written next to each input */
+#define FILES_SUFFIX ".out"
+
+/* A read or write of len bytes of buf at off in fd, in flight while busy,
+ * and then its result: bytes done, or -errno.
+ */
+typedef struct op {
+	bool busy, write;
+	int fd;
+	struct iovec iov;
+	off_t off;
+	ssize_t res;
+} op;
+
+/* Does ops with io_uring, if the kernel allows it, else with pread() and
+ * pwrite() as soon as they're submitted.
+ */
+typedef struct io {
+#ifdef __linux__
+	int ring; /* Or -1 */
+	void *sq_map, *cq_map;
+	size_t sq_size, cq_size, sqes_size;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+#endif
+	char dummy; /* So it's never empty */
+} io;
+
+/* Ops in flight at once: a read and a write per buffer */
+#define IO_DEPTH 4
+
+#ifdef __linux__
+static void io_init(io *io)
+{
+	struct io_uring_params p = {0};
+	io->ring = syscall(SYS_io_uring_setup, IO_DEPTH, &p);
+	if (io->ring < 0)
+		return;
+
+	io->sq_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+	io->cq_size = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+	io->sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+	io->sq_map = mmap(NULL, io->sq_size, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, io->ring, IORING_OFF_SQ_RING);
+	io->cq_map = mmap(NULL, io->cq_size, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, io->ring, IORING_OFF_CQ_RING);
+	io->sqes = mmap(NULL, io->sqes_size, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, io->ring, IORING_OFF_SQES);
+	if (io->sq_map == MAP_FAILED || io->cq_map == MAP_FAILED
+			|| io->sqes == MAP_FAILED) {
+		if (io->sq_map != MAP_FAILED)
+			munmap(io->sq_map, io->sq_size);
+		if (io->cq_map != MAP_FAILED)
+			munmap(io->cq_map, io->cq_size);
+		if (io->sqes != MAP_FAILED)
+			munmap(io->sqes, io->sqes_size);
+		close(io->ring);
+		io->ring = -1;
+		return;
+	}
+
+	char *sq = io->sq_map, *cq = io->cq_map;
+	io->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	io->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	io->sq_array = (unsigned *)(sq + p.sq_off.array);
+	io->cq_head = (unsigned *)(cq + p.cq_off.head);
+	io->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	io->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	io->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+}
+
+static void io_fini(io *io)
+{
+	if (io->ring < 0)
+		return;
+	munmap(io->sq_map, io->sq_size), munmap(io->cq_map, io->cq_size);
+	munmap(io->sqes, io->sqes_size);
+	close(io->ring);
+}
+
+static bool io_uring(const io *io)
+{
+	return io->ring >= 0;
+}
+
+/* Queues o on the ring and tells the kernel, returning false on error.
+ * There's always room, as no more than IO_DEPTH ops are ever in flight.
+ */
+static bool ring_submit(io *io, op *o)
+{
+	unsigned tail = *io->sq_tail, i = tail & *io->sq_mask;
+	io->sqes[i] = (struct io_uring_sqe){
+		.opcode = o->write ? IORING_OP_WRITEV : IORING_OP_READV,
+		.fd = o->fd, .addr = (uintptr_t)&o->iov, .len = 1,
+		.off = o->off, .user_data = (uintptr_t)o
+	};
+	io->sq_array[i] = i;
+	__atomic_store_n(io->sq_tail, tail+1, __ATOMIC_RELEASE);
+
+	int r;
+	while ((r = syscall(SYS_io_uring_enter, io->ring, 1, 0, 0, NULL, 0)) < 0
+			&& errno == EINTR)
+		;
+	return r == 1;
+}
+
+/* Waits for a completion on the ring and reaps them all, resubmitting
+ * the rest of short writes. Returns false on error.
+ */
+static bool ring_reap(io *io)
+{
+	unsigned head = *io->cq_head;
+	while (head == __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE))
+		if (syscall(SYS_io_uring_enter, io->ring, 0, 1,
+				IORING_ENTER_GETEVENTS, NULL, 0) < 0
+				&& errno != EINTR)
+			return false;
+
+	for (; head != __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE); head++) {
+		const struct io_uring_cqe *c = &io->cqes[head & *io->cq_mask];
+		op *o = (op *)(uintptr_t)c->user_data;
+		if (o->write && c->res > 0 && (size_t)c->res < o->iov.iov_len) {
+			o->iov.iov_base = (char *)o->iov.iov_base + c->res;
+			o->iov.iov_len -= c->res, o->off += c->res;
+			__atomic_store_n(io->cq_head, head+1, __ATOMIC_RELEASE);
+			if (!ring_submit(io, o))
+				return false;
+			continue;
+		}
+		o->res = c->res, o->busy = false;
+		__atomic_store_n(io->cq_head, head+1, __ATOMIC_RELEASE);
+	}
+	return true;
+}
+#else
+static void io_init(io *io)
+{
+	(void)io;
+}
+
+static void io_fini(io *io)
+{
+	(void)io;
+}
+
+static bool io_uring(const io *io)
+{
+	(void)io;
+	return false;
+}
+#endif
+
+/* Does o at once, with a single read or every byte of a write */
+static void io_sync(op *o)
+{
+	ssize_t r;
+	o->res = 0;
+	do {
+		while ((r = o->write ? pwrite(o->fd, o->iov.iov_base,
+				o->iov.iov_len, o->off)
+				: pread(o->fd, o->iov.iov_base, o->iov.iov_len,
+				o->off)) < 0 && errno == EINTR)
+			;
+		if (r < 0) {
+			o->res = -errno;
+			return;
+		}
+		o->res += r, o->off += r;
+		o->iov.iov_base = (char *)o->iov.iov_base + r;
+		o->iov.iov_len -= r;
+	} while (o->write && r && o->iov.iov_len);
+}
+
+/* Starts o, of len bytes of buf at off in fd */
+static void io_submit(io *io, op *o, bool write, int fd, void *buf,
+		size_t len, off_t off)
+{
+	*o = (op){.busy = true, .write = write, .fd = fd,
+		.iov = {buf, len}, .off = off};
+#ifdef __linux__
+	if (io_uring(io)) {
+		if (!ring_submit(io, o))
+			o->res = -EIO, o->busy = false;
+		return;
+	}
+#else
+	(void)io;
+#endif
+	io_sync(o);
+	o->busy = false;
+}
+
+/* Waits for o if it's in flight, returning its result */
+static ssize_t io_wait(io *io, op *o)
+{
+#ifdef __linux__
+	while (o->busy)
+		if (!ring_reap(io))
+			return -EIO; /* Ops in flight are lost with the ring */
+#else
+	(void)io;
+#endif
+	return o->res;
+}
+
+/* Buffers convert_file() reuses for every file */
+typedef struct bufs {
+	char *in[2];
+	str out[2], carry; /* carry has the incomplete line of the last block */
+} bufs;
+
+/* Converts complete lines of [p, end) into dst, first completing the line
+ * begun in carry, and leaving any incomplete line at the end in carry,
+ * or at eof, converting that too.
+ * Returns false only for reallocation errors.
+ */
+static bool convert_block(const char *p, const char *end, bool eof,
+		st_fmtflags fmt, cache *memo, str *carry, str *dst,
+		bool *allgood)
+{
+	if (carry->len) {
+		const char *nl = memchr(p, '\n', end-p);
+		const char *rest = nl ? nl+1 : end;
+		if (!str_insert(carry, carry->len, p, rest-p))
+			return false;
+		if (!nl && !eof)
+			return true;
+		if (!convert_lines(str_arr(carry), str_arr(carry)+carry->len,
+				fmt, memo, dst, allgood))
+			return false;
+		carry->len = 0, p = rest;
+	}
+	const char *last = end;
+	if (!eof)
+		while (last > p && last[-1] != '\n')
+			last--;
+	return convert_lines(p, last, fmt, memo, dst, allgood)
+		&& str_insert(carry, 0, last, end-last);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/* Converts the lines of the file at path into path FILES_SUFFIX like
+ * batch() does, while the next block is read and the last written.
+ * Adds the bytes read and written to *nin and *nout.
+ *
+ * Returns NULL or an error message.
+ */
+static const char *convert_file(io *io, const char *path, st_fmtflags fmt,
+		cache *memo, bufs *b, bool *allgood,
+		unsigned long long *nin, unsigned long long *nout)
+{
+	const char *err = NULL;
+	size_t plen = strlen(path);
+	char *outpath = malloc(plen + sizeof(FILES_SUFFIX));
+	if (!outpath)
+		return "Out of memory";
+	memcpy(outpath, path, plen);
+	memcpy(outpath+plen, FILES_SUFFIX, sizeof(FILES_SUFFIX));
+
+	int in = open(path, O_RDONLY), out = -1;
+	if (in < 0)
+		err = "Couldn't open it";
+	else if ((out = open(outpath, O_WRONLY|O_CREAT|O_TRUNC, 0666)) < 0)
+		err = "Couldn't create its output";
+	free(outpath);
+	if (err)
+		goto end;
+
+	/* Block k is read into in[k%2] and converted into out[k%2] */
+	op rd[2] = {{0}}, wr[2] = {{0}};
+	off_t roff = 0, woff = 0;
+	b->carry.len = 0;
+	io_submit(io, &rd[0], false, in, b->in[0], FILES_BLOCK, 0);
+	for (size_t k = 0;; k ^= 1) {
+		STATS_BEGIN();
+		ssize_t n = io_wait(io, &rd[k]);
+		STATS_END(STAGE_READ, n < 0);
+		if (n < 0) {
+			err = "Couldn't read it";
+			break;
+		}
+		roff += n, *nin += n;
+		if (n)
+			io_submit(io, &rd[k^1], false, in, b->in[k^1],
+				FILES_BLOCK, roff);
+
+		/* Reuse out[k] once its last write is done */
+		STATS_BEGIN();
+		ssize_t w = io_wait(io, &wr[k]);
+		STATS_END(STAGE_WRITE, w < 0);
+		if (w < 0) {
+			err = "Couldn't write its output";
+			break;
+		}
+		b->out[k].len = 0;
+		if (!convert_block(b->in[k], b->in[k]+n, !n, fmt, memo,
+				&b->carry, &b->out[k], allgood)) {
+			err = "Out of memory";
+			break;
+		}
+		if (b->out[k].len) {
+			io_submit(io, &wr[k], true, out, str_arr(&b->out[k]),
+				b->out[k].len, woff);
+			woff += b->out[k].len, *nout += b->out[k].len;
+		}
+		if (!n)
+			break;
+	}
+	/* Buffers mustn't be reused while the kernel may use them */
+	for (size_t k = 0; k < 2; k++) {
+		io_wait(io, &rd[k]);
+		if (io_wait(io, &wr[k]) < 0 && !err)
+			err = "Couldn't write its output";
+	}
+end:
+	if (in >= 0)
+		close(in);
+	if (out >= 0 && close(out) && !err)
+		err = "Couldn't write its output";
+	return err;
+}
+
+int files(st_fmtflags fmt, char *const *paths, size_t npaths,
+		size_t cachecap)
+{
+	bool allgood = true, failed = false;
+	io io;
+	io_init(&io);
+	bufs b = {
+		.in = {malloc(FILES_BLOCK), malloc(FILES_BLOCK)},
+		.out = {str_create(BATCH_OUTBUF), str_create(BATCH_OUTBUF)},
+		.carry = str_create(0)
+	};
+	cache *memo = cachecap ? cache_create(cachecap) : NULL;
+	if (!b.in[0] || !b.in[1] || (cachecap && !memo)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		failed = true;
+		goto end;
+	}
+
+	unsigned long long totin = 0, totout = 0;
+	double t0 = now();
+	for (size_t i = 0; i < npaths; i++) {
+		unsigned long long nin = 0, nout = 0;
+		double t = now();
+		const char *err = convert_file(&io, paths[i], fmt, memo, &b,
+			&allgood, &nin, &nout);
+		t = now() - t;
+		if (err) {
+			fprintf(stderr, "Error: %s: %s.\n", paths[i], err);
+			failed = true;
+			continue;
+		}
+		fprintf(stderr, "%s: %.1f MB in %.3f s, %.1f MB/s\n", paths[i],
+			nin/1e6, t, t > 0 ? nin/1e6/t : 0.0);
+		totin += nin, totout += nout;
+	}
+	double t = now() - t0;
+	fprintf(stderr, "Total: %zu file%s, %.1f MB in, %.1f MB out in %.3f s, "
+		"%.1f MB/s, with %s.\n", npaths, npaths == 1 ? "" : "s",
+		totin/1e6, totout/1e6, t, t > 0 ? totin/1e6/t : 0.0,
+		io_uring(&io) ? "io_uring" : "pread and pwrite");
+end:
+	if (memo)
+		report_cache(&memo, 1);
+	free(b.in[0]), free(b.in[1]);
+	str_destroy(&b.out[0]), str_destroy(&b.out[1]), str_destroy(&b.carry);
+	cache_destroy(memo);
+	io_fini(&io);
+	return allgood && !failed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
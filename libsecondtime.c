@@ -0,0 +1,1254 @@
+#include <math.h>   /* fmodl, fabsl, frexpl, ldexpl, isfinite, isnan, signbit */
+#include <float.h>  /* DECIMAL_DIG, LDBL_EPSILON, LDBL_MANT_DIG, LDBL_MIN_EXP,
+                     * LDBL_MAX_EXP */
+#include <errno.h>  /* errno, ERANGE */
+#include <stdlib.h> /* strtold */
+#include <stdint.h> /* uint_least32_t, uint_least64_t, int_least64_t,
+                     * uint_fast8_t, uintmax_t, int_fast8_t */
+#include <ctype.h>  /* isspace */
+#include <string.h> /* memcpy, memset */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h> /* SSE2, AVX2 and FMA intrinsics */
+#endif
+
+#include "secondtime.h"
+#include "config.h" /* Exports SELECTED_YEAR, HOW_TO_PRINT_FLOATS */
+
+/* NS_IN_YR is SECS_IN_YR in nanoseconds, exactly */
+#if SELECTED_YEAR == NORMAL_YEAR
+#define SECS_IN_YR 31536000.0L
+#define NS_IN_YR   UINT64_C(31536000000000000)
+#elif SELECTED_YEAR == LEAP_YEAR
+#define SECS_IN_YR 31622400.0L
+#define NS_IN_YR   UINT64_C(31622400000000000)
+#elif SELECTED_YEAR == JULIAN_YEAR
+#define SECS_IN_YR 31557600.0L
+#define NS_IN_YR   UINT64_C(31557600000000000)
+#elif SELECTED_YEAR == GREGORIAN_YEAR
+#define SECS_IN_YR 31556952.0L
+#define NS_IN_YR   UINT64_C(31556952000000000)
+#elif SELECTED_YEAR == TROPICAL_YEAR
+#define SECS_IN_YR 31556925.216L
+#define NS_IN_YR   UINT64_C(31556925216000000)
+#elif SELECTED_YEAR == SIDEREAL_YEAR
+#define SECS_IN_YR 31558149.7635L
+#define NS_IN_YR   UINT64_C(31558149763500000)
+#else
+#error "Invalid value for SELECTED_YEAR in config.h"
+#endif
+#define NS_IN_S UINT64_C(1000000000)
+
+_Static_assert(NS_IN_YR % 12 == 0, "Months aren't whole nanoseconds");
+_Static_assert(NS_IN_YR < UINT64_MAX/10, "rtoa() needs room for a digit");
+
+/* X(i, secs, ns, sfx) for each unit in st_units, in order */
+#define UNITS(X)                                    \
+	X(0, SECS_IN_YR   , NS_IN_YR          , 'y') \
+	X(1, SECS_IN_YR/12, NS_IN_YR/12       , 'M') \
+	X(2, 604800       , 604800*NS_IN_S    , 'w') \
+	X(3, 86400        , 86400*NS_IN_S     , 'd') \
+	X(4, 3600         , 3600*NS_IN_S      , 'h') \
+	X(5, 60           , 60*NS_IN_S        , 'm') \
+	X(6, 1            , NS_IN_S           , 's')
+
+const st_unit st_units[ST_NUNITS] = {
+#define X(i, secs, ns, sfx) [i] = {secs, sfx},
+	UNITS(X)
+#undef X
+};
+
+/* Lengths of st_units in nanoseconds */
+static const uint_least64_t unit_ns[ST_NUNITS] = {
+#define X(i, secs, ns, sfx) [i] = ns,
+	UNITS(X)
+#undef X
+};
+
+/* sfx_class[c] is 1 + index in st_units of suffix c, or 0 if c isn't one */
+static const uint_least8_t sfx_class[UCHAR_MAX+1] = {
+#define X(i, secs, ns, sfx) [(unsigned char)(sfx)] = i+1,
+	UNITS(X)
+#undef X
+};
+
+/* i < bits in st_fmtflags */
+static inline bool fmtflags_get(st_fmtflags x, uint_fast8_t i)
+{
+	return x & (1 << i);
+}
+/* x is never NULL */
+static inline void fmtflags_set(st_fmtflags *x, uint_fast8_t i)
+{
+	*x = *x | (1 << i);
+}
+static inline bool fmtflags_anysetafter(st_fmtflags x, uint_fast8_t i)
+{
+	/* EXPLANATION:
+	 * Say the low 7 bits of x are 0010100.
+	 * We want to check if any bits after the 3rd bit are set (i=2).
+	 * (1 << 3) gives 0001000.
+	 * (1 << 3)-1 gives 0000111.
+	 * ~((1 << 3)-1) gives 1111000.
+	 * when we bitwise AND this with x:
+	 * All bits until (and including) i are set to 0 (1&0 = 0, 0&0 = 0).
+	 * All bits thereafter are unchanged because (0&1 = 0, 1&1 = 1).
+	 * The resulting value, if any bits were after i were set,
+	 * will evaluate to true when converted to bool.
+	 */
+	return x & ~((1 << (i+1)) - 1);
+	
+}
+
+#define LEN(x) (sizeof(x)/sizeof(x[0]))
+
+/* Inlines a function everywhere it's called, or never, where compilers
+ * allow, else leaves it to them.
+ */
+#ifdef __GNUC__
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#define NEVER_INLINE  __attribute__((noinline))
+#else
+#define ALWAYS_INLINE inline
+#define NEVER_INLINE
+#endif
+
+/* About %g: https://stackoverflow.com/a/54162153/13651625
+ * About DECIMAL_DIG: https://stackoverflow.com/a/19897395
+ *
+ * LDBL_PREC is the precision ldtoa() prints with, as %.<LDBL_PREC>Lg would.
+ */
+#if HOW_TO_PRINT_FLOATS == READABLY_PRINT_FLOATS
+#define LDBL_PREC 6
+#elif HOW_TO_PRINT_FLOATS == ACCURATELY_PRINT_FLOATS
+#define LDBL_PREC DECIMAL_DIG
+#else
+#error "Invalid value for HOW_TO_PRINT_FLOATS in config.h" 
+#endif
+
+/* Upper bounds on decimal digits in a uintmax_t and the exponent of a
+ * long double. 31/100 > log10(2) so these never undercount.
+ */
+#define UINTMAX_DIG (sizeof(uintmax_t)*CHAR_BIT*31/100 + 1)
+#define LDBL_EXP_DIG 6
+
+/* Max chars written by utoa() and ldtoa() */
+#define UTOA_MAX  UINTMAX_DIG
+#define LDTOA_MAX (1 /* - */ + LDBL_PREC + 1 /* . */ + 4 /* 0.000 */ \
+		   + 2 /* e+ */ + LDBL_EXP_DIG)
+/* Max chars written by s2str(), including the terminating NUL */
+#define S2STR_MAX (LEN(st_units)*(UTOA_MAX + 2) + LDTOA_MAX + 2)
+
+_Static_assert(LDTOA_MAX < ST_LDTOA_MAX && S2STR_MAX <= ST_S2STR_MAX,
+		"Bounds in secondtime.h are too small");
+
+/* Writes x in decimal to dst as %ju would, without NUL-terminating.
+ * Returns number of chars written.
+ *
+ * Out of line, as every unit of every ns2str_fmt[] function writes with it.
+ */
+static NEVER_INLINE size_t utoa(char *dst, uintmax_t x)
+{
+	char buf[UTOA_MAX], *p = buf+sizeof(buf);
+	do
+		*--p = '0' + x%10;
+	while (x /= 10);
+
+	size_t n = buf+sizeof(buf) - p;
+	memcpy(dst, p, n);
+	return n;
+}
+
+/* Arbitrary precision naturals for ldtoa(), as arrays of 32-bit limbs,
+ * least significant first. Sized for any finite long double.
+ */
+typedef uint_least32_t limb;
+enum {
+	LDBL_LIMBS = (LDBL_MANT_DIG+31)/32,
+	/* Integer part: up to LDBL_MAX_EXP bits, shifted by a limb at most */
+	INT_LIMBS  = LDBL_MAX_EXP/32 + LDBL_LIMBS + 1,
+	/* Fraction part: up to (LDBL_MANT_DIG - LDBL_MIN_EXP) bits */
+	FRAC_LIMBS = (LDBL_MANT_DIG - LDBL_MIN_EXP)/32 + 2*LDBL_LIMBS + 1,
+	/* Decimal digits in the integer part */
+	INT_DIG    = LDBL_MAX_10_EXP + 10,
+	/* Digits generated before rounding: LDBL_PREC, a rounding digit and
+	 * upto 8 more from the last 9-digit chunk
+	 */
+	SIG_DIG    = LDBL_PREC + 1 + 9
+};
+
+/* Divides n-limb a by 1e9 in place, returning the remainder */
+static inline limb limbs_div1e9(limb *a, size_t n)
+{
+	uint_least64_t r = 0;
+	while (n --> 0) {
+		r = r << 32 | a[n];
+		a[n] = r / 1000000000;
+		r %= 1000000000;
+	}
+	return r;
+}
+
+/* Multiplies limbs a[lo..n) by 1e9 in place, returning the carry out */
+static inline limb limbs_mul1e9(limb *a, size_t lo, size_t n)
+{
+	uint_least64_t c = 0;
+	for (size_t i = lo; i < n; i++) {
+		c += (uint_least64_t)a[i] * 1000000000;
+		a[i] = (limb)c;
+		c >>= 32;
+	}
+	return c;
+}
+
+/* Writes finite non-negative x's exact decimal digits to sig,
+ * upto SIG_DIG significant digits, and its decimal exponent to exp,
+ * such that x ~= 0.sig * 10^exp. Sets *sticky if digits were left out.
+ * Returns the number of digits written.
+ */
+static size_t ldigits(long double x, char *sig, int *exp, bool *sticky)
+{
+	/* Extract mantissa M as limbs such that x = M * 2^e */
+	limb m[LDBL_LIMBS];
+	int e;
+	long double f = frexpl(x, &e);
+	for (size_t i = LDBL_LIMBS; i --> 0;) {
+		f = ldexpl(f, 32);
+		m[i] = (limb)f;
+		f -= m[i];
+	}
+	e -= 32*LDBL_LIMBS;
+
+	/* Split into integer part I and fraction F / 2^(32*fn) */
+	limb I[INT_LIMBS], F[FRAC_LIMBS];
+	size_t in, fn;
+	if (e >= 0) {
+		size_t q = e/32, r = e%32;
+		in = q+LDBL_LIMBS+1, fn = 0;
+		memset(I, 0, in*sizeof(limb));
+		for (size_t i = 0; i < LDBL_LIMBS; i++) {
+			uint_least64_t v = (uint_least64_t)m[i] << r;
+			I[q+i] |= (limb)v;
+			I[q+i+1] |= (limb)(v >> 32);
+		}
+	} else {
+		/* Shift M left so the binary point falls on a limb boundary,
+		 * then limbs below it are F and the rest are I.
+		 */
+		size_t fbits = -e, r = (32 - fbits%32) % 32;
+		limb t[LDBL_LIMBS+1] = {0};
+		for (size_t i = 0; i < LDBL_LIMBS; i++) {
+			uint_least64_t v = (uint_least64_t)m[i] << r;
+			t[i] |= (limb)v;
+			t[i+1] |= (limb)(v >> 32);
+		}
+		in = 0, fn = (fbits+r)/32;
+		for (size_t i = 0; i < fn; i++)
+			F[i] = i <= LDBL_LIMBS ? t[i] : 0;
+		for (size_t i = fn; i <= LDBL_LIMBS; i++)
+			I[in++] = t[i];
+	}
+	while (in && !I[in-1])
+		in--;
+
+	size_t nd = 0;
+	*exp = 0;
+	*sticky = false;
+
+	/* Integer digits, generated least significant chunk first */
+	if (in) {
+		char idig[INT_DIG + 9];
+		size_t ni = 0;
+		while (in) {
+			limb c = limbs_div1e9(I, in);
+			for (int k = 0; k < 9; k++, c /= 10)
+				idig[ni++] = '0' + c%10;
+			while (in && !I[in-1])
+				in--;
+		}
+		while (idig[ni-1] == '0') /* Leading zeros of last chunk */
+			ni--;
+		*exp = ni;
+		while (ni && nd < SIG_DIG)
+			sig[nd++] = idig[--ni];
+		while (ni && !*sticky)
+			*sticky = idig[--ni] != '0';
+	}
+
+	/* Fraction digits, most significant chunk first */
+	size_t lo = 0;
+	while (lo < fn && !F[lo])
+		lo++;
+	while (nd < SIG_DIG && lo < fn) {
+		limb c = limbs_mul1e9(F, lo, fn);
+		char chunk[9];
+		for (int k = 9; k --> 0; c /= 10)
+			chunk[k] = '0' + c%10;
+		for (int k = 0; k < 9; k++) {
+			if (nd || chunk[k] != '0') {
+				if (nd < SIG_DIG)
+					sig[nd++] = chunk[k];
+				else
+					*sticky |= chunk[k] != '0';
+			} else
+				--*exp; /* Leading zero after the point */
+		}
+		while (lo < fn && !F[lo])
+			lo++;
+	}
+	*sticky |= lo < fn;
+	return nd;
+}
+
+/* Writes the positive number 0.sig * 10^exp, of nd digits and more
+ * nonzero ones if sticky, as %.<LDBL_PREC>Lg would, without
+ * NUL-terminating. sig must have room for SIG_DIG digits.
+ * Returns number of chars written.
+ */
+static size_t sigtoa(char *dst, char *sig, size_t nd, int exp, bool sticky)
+{
+	char *p = dst;
+	while (nd < LDBL_PREC+1)
+		sig[nd++] = '0';
+
+	/* Round half to even to LDBL_PREC digits */
+	char r = sig[LDBL_PREC];
+	for (size_t i = LDBL_PREC+1; i < nd && !sticky; i++)
+		sticky = sig[i] != '0';
+	if (r > '5' || (r == '5' && (sticky || (sig[LDBL_PREC-1]-'0') % 2))) {
+		size_t i = LDBL_PREC;
+		while (i && sig[i-1] == '9')
+			sig[--i] = '0';
+		if (i)
+			sig[i-1]++;
+		else /* 999.. became 1000.. */
+			sig[0] = '1', exp++;
+	}
+
+	/* %g drops trailing zeros */
+	nd = LDBL_PREC;
+	while (nd > 1 && sig[nd-1] == '0')
+		nd--;
+
+	int x10 = exp-1; /* Exponent in scientific notation */
+	if (x10 < -4 || x10 >= LDBL_PREC) {
+		*p++ = sig[0];
+		if (nd > 1) {
+			*p++ = '.';
+			memcpy(p, sig+1, nd-1), p += nd-1;
+		}
+		*p++ = 'e';
+		*p++ = x10 < 0 ? '-' : '+';
+		unsigned ux = x10 < 0 ? -x10 : x10;
+		if (ux < 10)
+			*p++ = '0';
+		p += utoa(p, ux);
+	} else if (x10 < 0) {
+		*p++ = '0', *p++ = '.';
+		for (int i = -1; i > x10; i--)
+			*p++ = '0';
+		memcpy(p, sig, nd), p += nd;
+	} else {
+		size_t ni = x10+1;
+		for (size_t i = 0; i < ni; i++)
+			*p++ = i < nd ? sig[i] : '0';
+		if (nd > ni) {
+			*p++ = '.';
+			memcpy(p, sig+ni, nd-ni), p += nd-ni;
+		}
+	}
+	return p - dst;
+}
+
+/* Writes x in decimal to dst as %.<LDBL_PREC>Lg would, without
+ * NUL-terminating. Returns number of chars written.
+ */
+static size_t ldtoa(char *dst, long double x)
+{
+	char *p = dst;
+	if (signbit(x))
+		*p++ = '-', x = -x;
+	if (isnan(x))
+		return memcpy(p, "nan", 3), p+3 - dst;
+	else if (isinf(x))
+		return memcpy(p, "inf", 3), p+3 - dst;
+	else if (fpclassify(x) == FP_ZERO)
+		return *p++ = '0', p - dst;
+
+	char sig[SIG_DIG];
+	int exp;
+	bool sticky;
+	size_t nd = ldigits(x, sig, &exp, &sticky);
+	return p - dst + sigtoa(p, sig, nd, exp, sticky);
+}
+
+/* Nanoseconds, wide enough for any value s2str() takes exactly */
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 nsec;
+#define NSEC_WIDE 1
+#define NSEC_SECS_MAX 0x1p64L
+#else
+typedef uint_least64_t nsec;
+#define NSEC_SECS_MAX 18446744073.0L /* ns below 2^64 */
+#endif
+
+/* Sets *ns to s seconds rounded to whole nanoseconds, if s is within its
+ * rounding error of them, as decimals of upto 9 places parse to, and
+ * every count s2str() writes fits in a uintmax_t.
+ * Returns false if not.
+ */
+static inline bool s2ns(long double s, nsec *ns)
+{
+	if (!(s < NSEC_SECS_MAX))
+		return false;
+	uint_least64_t whole = s; /* truncates, leaving s-whole exact */
+	long double frac = (s - whole) * NS_IN_S;
+	uint_least64_t sub = frac + 0.5L;
+	/* s*LDBL_EPSILON bounds s's ulp, and so errors in s and frac */
+	if (fabsl(frac - sub) > s * (NS_IN_S * LDBL_EPSILON))
+		return false;
+	*ns = (nsec)whole*NS_IN_S + sub;
+	return true;
+}
+
+/* Divides *ns by unit, leaving the remainder in *ns. A constant unit
+ * makes it a multiply and shifts, unless *ns is wider than 64 bits,
+ * which it can only be if wide, and for a first division.
+ */
+static ALWAYS_INLINE uint_least64_t ns_div(nsec *ns, uint_least64_t unit,
+		bool wide)
+{
+	uint_least64_t q;
+#ifdef NSEC_WIDE
+	if (wide && *ns > UINT_LEAST64_MAX)
+		q = *ns / unit, *ns %= unit;
+	else
+#else
+	(void)wide;
+#endif
+	{
+		uint_least64_t n = *ns;
+		q = n / unit, *ns = n % unit;
+	}
+	return q;
+}
+
+/* Writes num/den in decimal to dst as ldtoa() would, but rounded
+ * exactly. den is nonzero.
+ * Returns number of chars written.
+ */
+static size_t rtoa(char *dst, nsec num, uint_least64_t den)
+{
+	if (!num)
+		return *dst = '0', 1;
+
+	char sig[SIG_DIG];
+	size_t nd = 0;
+	int exp = 0;
+	bool sticky = false;
+	uintmax_t q = num / den; /* Fits, as s2ns() ensures */
+	uint_least64_t r = num % den;
+	if (q) { /* Integer digits, then the fraction's */
+		char buf[UTOA_MAX];
+		size_t ni = utoa(buf, q);
+		exp = ni;
+		nd = ni < SIG_DIG ? ni : SIG_DIG;
+		memcpy(sig, buf, nd);
+		for (size_t i = nd; i < ni; i++)
+			sticky |= buf[i] != '0';
+	}
+	/* r < den < 2^64/10, so r*10 doesn't overflow */
+	for (; r && nd < SIG_DIG; r %= den) {
+		r *= 10;
+		char d = '0' + r/den;
+		if (nd || d != '0')
+			sig[nd++] = d;
+		else
+			exp--; /* Leading zero after the point */
+	}
+	return sigtoa(dst, sig, nd, exp, sticky || r);
+}
+
+/* s2str() of ns nanoseconds, exactly, as a step per unit that format
+ * selects. A constant format leaves straight-line code of just those.
+ * ns may be 64 bits or more only if wide.
+ */
+static ALWAYS_INLINE size_t ns2str(nsec ns, st_fmtflags format, bool wide,
+		char *dst)
+{
+	char *p = dst;
+
+#define X(i, secs, ns_, sfx)                                              \
+	if (!fmtflags_get(format, i))                                     \
+		;                                                         \
+	else if (fmtflags_anysetafter(format, i)) {                       \
+		uint_least64_t x = ns_div(&ns, ns_, wide);                 \
+		if (x) {                                                  \
+			p += utoa(p, x);                                  \
+			*p++ = sfx;                                       \
+			*p++ = ' ';                                       \
+		}                                                         \
+	} else if (ns || p == dst) {                                      \
+		p += rtoa(p, ns, ns_);                                    \
+		*p++ = sfx;                                               \
+	}
+	UNITS(X)
+#undef X
+	*p = '\0';
+	return p-dst;
+}
+
+/* ns2str() for every format, as ns2str_0x00() to ns2str_0xFF() of ns
+ * below 2^64, each with the format a constant. Formats are fixed for
+ * many values in most uses, so testing them per unit of every value is
+ * wasted. Bit 7, beyond any unit, only makes the last unit whole.
+ */
+_Static_assert(ST_FMT_ALL == 0xFF, "ns2str_fmt[] has a format per byte");
+#define FMTS16(X, h)                                         \
+	X(0x##h##0) X(0x##h##1) X(0x##h##2) X(0x##h##3) \
+	X(0x##h##4) X(0x##h##5) X(0x##h##6) X(0x##h##7) \
+	X(0x##h##8) X(0x##h##9) X(0x##h##A) X(0x##h##B) \
+	X(0x##h##C) X(0x##h##D) X(0x##h##E) X(0x##h##F)
+#define FMTS(X)                                                \
+	FMTS16(X, 0) FMTS16(X, 1) FMTS16(X, 2) FMTS16(X, 3) \
+	FMTS16(X, 4) FMTS16(X, 5) FMTS16(X, 6) FMTS16(X, 7) \
+	FMTS16(X, 8) FMTS16(X, 9) FMTS16(X, A) FMTS16(X, B) \
+	FMTS16(X, C) FMTS16(X, D) FMTS16(X, E) FMTS16(X, F)
+
+#define X(f) static size_t ns2str_##f(uint_least64_t ns, char *dst) \
+	{ return ns2str(ns, f, false, dst); }
+FMTS(X)
+#undef X
+
+static size_t (*const ns2str_fmt[])(uint_least64_t ns, char *dst) = {
+#define X(f) [f] = ns2str_##f,
+	FMTS(X)
+#undef X
+};
+
+/* ns2str() of any ns, by ns2str_fmt[] where it's below 2^64 */
+static inline size_t ns2str_any(nsec ns, st_fmtflags format, char *dst)
+{
+	return ns <= UINT_LEAST64_MAX ? ns2str_fmt[format](ns, dst)
+		: ns2str(ns, format, true, dst);
+}
+
+/* Convert s seconds to str in specified format.
+ *
+ * If bit i of format is set, the st_units[i] unit is converted to,
+ * else not. 
+ * Conversion begins with the largest unit,
+ * converting the seconds to the greatest natural number of units,
+ * then doing the same with the remaining seconds for the next largest unit,
+ * and for the last unit convert remaining seconds to fractional number.
+ * 
+ * Whole nanoseconds convert exactly in integers with ns2str(), and
+ * the rest in long double.
+ *
+ * dst must have room for S2STR_MAX chars, the result is NUL-terminated.
+ * Returns number of chars written excluding the NUL.
+ */
+static size_t s2str(long double s, st_fmtflags format, char *dst)
+{
+	nsec ns;
+	if (s2ns(s, &ns))
+		return ns2str_any(ns, format, dst);
+
+	char *p = dst;
+
+	for (uint_fast8_t i = 0; i < LEN(st_units); i++) {
+		if (!fmtflags_get(format, i))
+			continue; /* Ignore this unit */
+
+		if (fmtflags_anysetafter(format, i)) {
+			uintmax_t x = s/st_units[i].secs; /* truncates */
+			s = fmodl(s, st_units[i].secs);
+
+			if (x) {
+				p += utoa(p, x);
+				*p++ = st_units[i].sfx;
+				*p++ = ' ';
+			}
+		} else { /* This is the last unit, convert to fractional.   */
+			long double x = s/st_units[i].secs;
+			/* If x is 0, write iff no units previously written */
+			if (fpclassify(x) == FP_ZERO && p != dst)
+				break;
+			p += ldtoa(p, x);
+			*p++ = st_units[i].sfx;
+		}
+	}
+	*p = '\0';
+	return p-dst;
+}
+
+/* If c is a suffix in st_units, return its index, else return -1 */
+static inline int_fast8_t isfx(char c)
+{
+	return sfx_class[(unsigned char)c] - 1;
+}
+
+/* parse_num() with strtold(), for what it can't convert exactly itself */
+static st_err parse_num_libc(const char *src, size_t len,
+		long double *dst, size_t *end)
+{
+	/* strtold() needs a NUL-terminated string */
+	char buf[ST_NUM_MAX+1], *ep;
+	*end = 0;
+	if (len > ST_NUM_MAX)
+		return ST_EINVAL;
+	memcpy(buf, src, len);
+	buf[len] = '\0';
+
+	int olderrno = errno; errno = 0;
+	long double x = strtold(buf, &ep);
+	int newerrno = errno; errno = olderrno;
+
+	*end = ep-buf;
+	if (ep == buf)
+		return ST_EINVAL;
+	else if (signbit(x) || !isfinite(x) || newerrno == ERANGE)
+		return ST_ERANGE;
+	*dst = x;
+	return ST_OK;
+}
+
+/* Powers of ten that are exact in a long double, as 5^k must fit in its
+ * significand, for parse_num() to scale by with a single rounding.
+ * Significands of upto FAST_SIG_MAX are exact too.
+ */
+#if LDBL_MANT_DIG >= 64
+#define FAST_POW10_MAX 27
+#define FAST_SIG_MAX   UINT64_MAX
+#elif LDBL_MANT_DIG >= 53
+#define FAST_POW10_MAX 22
+#define FAST_SIG_MAX   (UINT64_C(1) << 53)
+#else
+#define FAST_POW10_MAX -1
+#define FAST_SIG_MAX   0
+#endif
+static const long double pow10[] = {
+	1e0L,  1e1L,  1e2L,  1e3L,  1e4L,  1e5L,  1e6L,  1e7L,  1e8L,  1e9L,
+	1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L,
+	1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L
+};
+_Static_assert(FAST_POW10_MAX < (int)LEN(pow10), "pow10[] is too short");
+
+static inline bool isdigit_(char c)
+{
+	return (unsigned)c - '0' < 10;
+}
+
+/* Converts number in src upto len chars to *dst, setting *end to the
+ * number of chars parsed, exactly as strtold() would in the C locale.
+ * Returns ST_OK, ST_EINVAL if no number could be parsed,
+ * or ST_ERANGE if the number is negative, non-finite or out of range.
+ *
+ * Decimals of upto 19 significant digits, times powers of ten that are
+ * exact, convert with a single correctly rounded multiply or divide
+ * (Clinger's fast path). The rest, and hex, infinities and NaNs, are
+ * left to strtold().
+ */
+static st_err parse_num(const char *src, size_t len,
+		long double *dst, size_t *end)
+{
+	*end = 0;
+	if (len > ST_NUM_MAX)
+		return ST_EINVAL;
+	const char *p = src, *lim = src+len;
+	while (p < lim && isspace((unsigned char)*p))
+		p++;
+	bool neg = p < lim && *p == '-';
+	if (p < lim && (*p == '-' || *p == '+'))
+		p++;
+	if (p < lim && ((*p|32) == 'i' || (*p|32) == 'n'
+			|| (*p == '0' && p+1 < lim && (p[1]|32) == 'x')))
+		return parse_num_libc(src, len, dst, end);
+
+	/* Significant digits in sig, and the power of ten to scale it by */
+	uint_least64_t sig = 0;
+	int nd = 0, exp = 0;
+	bool any = false, point = false;
+	for (; p < lim; p++) {
+		if (*p == '.' && !point) {
+			point = true;
+			continue;
+		} else if (!isdigit_(*p))
+			break;
+		any = true;
+		/* Past 19 digits, which fit as 10^19 < 2^64, only counted */
+		if ((sig || *p != '0') && nd++ < 19)
+			sig = sig*10 + (*p-'0');
+		exp -= point;
+	}
+	if (!any)
+		return ST_EINVAL;
+
+	/* An exponent, if it has digits */
+	if (p < lim && (*p|32) == 'e') {
+		const char *q = p+1;
+		bool eneg = q < lim && *q == '-';
+		if (q < lim && (*q == '-' || *q == '+'))
+			q++;
+		if (q < lim && isdigit_(*q)) {
+			int e = 0;
+			for (; q < lim && isdigit_(*q); q++)
+				if (e < 100000)
+					e = e*10 + (*q-'0');
+			exp += eneg ? -e : e;
+			p = q;
+		}
+	}
+	*end = p-src;
+
+	if (neg)
+		return ST_ERANGE;
+	else if (!sig)
+		return *dst = 0, ST_OK;
+	else if (nd > 19 || sig > FAST_SIG_MAX
+			|| exp < -FAST_POW10_MAX || exp > FAST_POW10_MAX)
+		return parse_num_libc(src, len, dst, end);
+	*dst = exp < 0 ? sig / pow10[-exp] : sig * pow10[exp];
+	return ST_OK;
+}
+
+st_err st_num2s(const char *src, size_t len, long double *dst)
+{
+	long double x;
+	size_t end;
+	st_err err = parse_num(src, len, &x, &end);
+	if (end != len)
+		return ST_EINVAL;
+	else if (!err)
+		*dst = x;
+	return err;
+}
+
+st_err st_str2s(const char *src, size_t len, unsigned flags,
+		long double *dst, size_t *errpos)
+{
+	/* Sum of each unit's terms, added smallest unit first at the end
+	 * for accuracy. While terms are whole nanoseconds, as s2ns() takes
+	 * them, their exact total in ns is the result instead.
+	 */
+	long double sums[ST_NUNITS] = {0};
+	uint_least64_t ns = 0;
+	bool exact = true;
+	int_fast8_t prev = -1;
+	size_t i = 0, beg = 0;
+	st_err err = ST_EINVAL;
+	if (!len) /* Nothing isn't 0 */
+		goto fail;
+
+	while (i < len) {
+		/* Coefficient is everything upto the next suffix */
+		beg = i;
+		while (i < len && !sfx_class[(unsigned char)src[i]])
+			i++;
+
+		/* Parsed with its suffix, which mustn't be taken as part of
+		 * it, as 'd' is by a hex coefficient like "0xed"
+		 */
+		long double x = 0;
+		size_t end = 0, n = i-beg + (i < len && i-beg < ST_NUM_MAX);
+		err = i == beg ? ST_OK /* No coefficient is 0 */
+			: parse_num(src+beg, n, &x, &end);
+		if (err == ST_ERANGE)
+			goto fail;
+		else if (err || end != i-beg) { /* Stopped at invalid char */
+			beg += end < i-beg ? end : i-beg, err = ST_EINVAL;
+			goto fail;
+		} else if (i == len) { /* Last coefficient lacks suffix */
+			beg = i, err = ST_EINVAL;
+			goto fail;
+		}
+
+		int_fast8_t ci = isfx(src[i]);
+		if (flags & ST_STRICT && ci <= prev) {
+			beg = i, err = ST_EINVAL;
+			goto fail;
+		}
+		prev = ci;
+		sums[ci] += x * st_units[ci].secs;
+		if (!isfinite(sums[ci])) {
+			err = ST_ERANGE;
+			goto fail;
+		}
+		if (exact) {
+			long double t = x * unit_ns[ci];
+			uint_least64_t n = t < 0x1p63L ? t + 0.5L : 0;
+			exact = t < 0x1p63L && fabsl(t - n) <= t*LDBL_EPSILON
+				&& ns <= UINT_LEAST64_MAX - n;
+			ns += n;
+		}
+		i++;
+	}
+
+	long double s = 0;
+	if (exact)
+		s = ns / (long double)NS_IN_S;
+	else for (uint_fast8_t j = ST_NUNITS; j --> 0;)
+		s += sums[j];
+	if (!isfinite(s)) {
+		beg = 0, err = ST_ERANGE;
+		goto fail;
+	}
+	*dst = s;
+	return ST_OK;
+fail:
+	if (errpos)
+		*errpos = beg;
+	return err;
+}
+
+st_err st_str2fmtflags(st_fmtflags *dst, const char *src)
+{
+	if (!src) {
+		*dst = ST_FMT_ALL;
+		return ST_OK;
+	}
+	
+	*dst = ST_FMT_NONE;
+	for (char c; (c = *src); src++) {
+		if (isspace(c))
+			continue;
+		
+		int_fast8_t i = isfx(c);
+		if (i < 0)
+			return ST_EINVAL;
+		else
+			fmtflags_set(dst, i);
+	}
+	return ST_OK;
+}
+
+st_err st_ldtoa(long double x, char *dst, size_t cap, size_t *len)
+{
+	char buf[LDTOA_MAX+1], *p = cap > LDTOA_MAX ? dst : buf;
+	size_t n = ldtoa(p, x);
+	p[n] = '\0';
+	if (p == buf) {
+		if (n >= cap)
+			return ST_ENOBUFS;
+		memcpy(dst, buf, n+1);
+	}
+	if (len)
+		*len = n;
+	return ST_OK;
+}
+
+st_err st_s2str(long double s, st_fmtflags fmt,
+		char *dst, size_t cap, size_t *len)
+{
+	if (signbit(s) || !isfinite(s))
+		return ST_ERANGE;
+
+	char buf[S2STR_MAX], *p = cap >= S2STR_MAX ? dst : buf;
+	size_t n = s2str(s, fmt, p);
+	if (p == buf) {
+		if (n >= cap)
+			return ST_ENOBUFS;
+		memcpy(dst, buf, n+1);
+	}
+	if (len)
+		*len = n;
+	return ST_OK;
+}
+
+/* Calendar arithmetic for st_s2str_anchored(), in days since 1970-01-01
+ * of the proleptic Gregorian calendar. It's all closed-form: leap days
+ * before a year are counted, not looped over, and days before a month
+ * come from cumdays[].
+ */
+#define SECS_IN_DAY  86400
+#define NS_IN_DAY    (SECS_IN_DAY * NS_IN_S)
+#define DAYS_TO_1970 719162 /* From 0001-01-01 */
+
+/* Days of a common year before each month, and in all of it */
+static const uint_least16_t cumdays[13] = {
+	0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365
+};
+
+/* a/b rounded towards -infinity, for b > 0 */
+static inline int_least64_t fdiv(int_least64_t a, int_least64_t b)
+{
+	return a/b - (a%b < 0);
+}
+
+/* Of years divisible by 4, those by 100 are by 25, and those by 400 are
+ * then by 16, which is cheaper to test.
+ */
+static inline bool isleap(int_least64_t y)
+{
+	return !(y & 3) && (y % 25 || !(y & 15));
+}
+
+/* Days before month m, from 1, of year y */
+static inline unsigned days_before(int_least64_t y, unsigned m)
+{
+	return cumdays[m-1] + (m > 2 && isleap(y));
+}
+
+static inline unsigned month_days(int_least64_t y, unsigned m)
+{
+	return cumdays[m] - cumdays[m-1] + (m == 2 && isleap(y));
+}
+
+static int_least64_t days_of(int_least64_t y, unsigned m, unsigned d)
+{
+	int_least64_t py = y-1;
+	return 365*py + fdiv(py, 4) - fdiv(py, 100) + fdiv(py, 400)
+		+ days_before(y, m) + d-1 - DAYS_TO_1970;
+}
+
+/* Sets *y and *m to the year and month of day */
+static void month_of(int_least64_t day, int_least64_t *y, unsigned *m)
+{
+	/* Years of 400 have the same days, and so do years of 100 and 4 in
+	 * them but for the last which has one more or less, so dividing
+	 * out the days of each in turn leaves the year.
+	 */
+	int_least64_t z = day + DAYS_TO_1970, era = fdiv(z, 146097);
+	int_least64_t doe = z - era*146097;
+	int_least64_t yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+	unsigned doy = doe - (365*yoe + yoe/4 - yoe/100);
+	*y = era*400 + yoe + 1;
+	/* Months have 28 to 31 days, so doy/32 is this one or the last */
+	*m = doy/32 + 1;
+	if (*m < 12 && doy >= days_before(*y, *m+1))
+		++*m;
+}
+
+/* Days since 1970-01-01 of k months after from, on the same day of
+ * the month or the last day of shorter months.
+ */
+static int_least64_t add_months(st_date from, int_least64_t k)
+{
+	int_least64_t mm = from.month-1 + k, y = from.year + fdiv(mm, 12);
+	unsigned m = mm - fdiv(mm, 12)*12 + 1;
+	unsigned d = month_days(y, m);
+	return days_of(y, m, from.day < d ? from.day : d);
+}
+
+/* Days in s seconds, or exactly in ns nanoseconds if exact */
+static inline int_least64_t days_in(long double s, nsec ns, bool exact)
+{
+	if (!exact)
+		return s / SECS_IN_DAY;
+	return ns <= UINT_LEAST64_MAX ? (uint_least64_t)ns / NS_IN_DAY
+		: ns / NS_IN_DAY;
+}
+
+/* s2str() of s seconds from 00:00 of from, for format with years or
+ * months, which are calendar ones. Months of from are counted from an
+ * estimate by the month s ends in, which is too many by one if from's
+ * day is later in its month, then split into years and months as fmt
+ * selects. The time from there goes to s2str() for the other units, in
+ * whole nanoseconds if s is, so it's as exact and about as fast. If
+ * years or months is the last unit, it gets the fraction of the next one
+ * that's passed.
+ *
+ * s must be below 2^62 and from valid, dst must have room for S2STR_MAX
+ * chars. Returns number of chars written excluding the NUL.
+ */
+static size_t s2str_anchored(long double s, st_date from, st_fmtflags format,
+		char *dst)
+{
+	char *p = dst;
+	nsec ns;
+	const bool exact = s2ns(s, &ns);
+	const int_least64_t a = days_of(from.year, from.month, from.day);
+	int_least64_t y;
+	unsigned m;
+	const int_least64_t d = days_in(s, ns, exact);
+	month_of(a + d, &y, &m);
+	int_least64_t months = (y - from.year)*12
+		+ ((int_least64_t)m - from.month);
+	int_least64_t off = add_months(from, months) - a; /* In days */
+	if (exact ? off > d : off*(long double)SECS_IN_DAY > s)
+		off = add_months(from, --months) - a;
+
+	static const uint_least8_t step[2] = {12, 1}; /* Months of each */
+	int_least64_t used = 0; /* Months written */
+	for (uint_fast8_t i = 0; i < 2; i++) {
+		if (!fmtflags_get(format, i))
+			continue;
+		int_least64_t x = (months - used) / step[i];
+		if (fmtflags_anysetafter(format, i)) {
+			used += x*step[i];
+			if (x) {
+				p += utoa(p, x);
+				*p++ = st_units[i].sfx;
+				*p++ = ' ';
+			}
+			continue;
+		}
+		int_least64_t t = add_months(from, used + x*step[i]);
+		int_least64_t next = add_months(from, used + (x+1)*step[i]);
+		long double f = x + (s - (t-a) * (long double)SECS_IN_DAY)
+			/ ((next-t) * (long double)SECS_IN_DAY);
+		if (f || p == dst) {
+			p += ldtoa(p, f);
+			*p++ = st_units[i].sfx;
+		}
+		*p = '\0';
+		return p-dst;
+	}
+
+	if (used != months)
+		off = add_months(from, used) - a;
+	format &= ~3;
+	if (exact) {
+		ns -= (nsec)off*NS_IN_DAY;
+		if (ns || p == dst)
+			p += ns2str_any(ns, format, p);
+	} else {
+		long double rest = s - off*(long double)SECS_IN_DAY;
+		if (rest || p == dst)
+			p += s2str(rest, format, p);
+	}
+	*p = '\0';
+	return p-dst;
+}
+
+st_err st_str2date(st_date *dst, const char *src)
+{
+	/* YYYY-MM-DD */
+	static const char shape[] = "0000-00-00";
+	unsigned v[3] = {0};
+	for (size_t i = 0, k = 0; i < sizeof(shape); i++) {
+		if (shape[i] == '-' || !shape[i]) {
+			if (src[i] != shape[i])
+				return ST_EINVAL;
+			k++;
+		} else if (!isdigit_(src[i]))
+			return ST_EINVAL;
+		else
+			v[k] = v[k]*10 + (src[i]-'0');
+	}
+	if (v[1]-1 >= 12 || v[2]-1 >= month_days(v[0], v[1]))
+		return ST_EINVAL;
+	*dst = (st_date){.year = v[0], .month = v[1], .day = v[2]};
+	return ST_OK;
+}
+
+st_err st_s2str_anchored(long double s, st_date from, st_fmtflags fmt,
+		char *dst, size_t cap, size_t *len)
+{
+	if (!fmtflags_get(fmt, 0) && !fmtflags_get(fmt, 1))
+		return st_s2str(s, fmt, dst, cap, len);
+	else if (signbit(s) || !isfinite(s) || s >= 0x1p62L)
+		return ST_ERANGE;
+	else if (from.month-1u >= 12
+			|| from.day-1u >= month_days(from.year, from.month))
+		return ST_EINVAL;
+
+	char buf[S2STR_MAX], *p = cap >= S2STR_MAX ? dst : buf;
+	size_t n = s2str_anchored(s, from, fmt, p);
+	if (p == buf) {
+		if (n >= cap)
+			return ST_ENOBUFS;
+		memcpy(dst, buf, n+1);
+	}
+	if (len)
+		*len = n;
+	return ST_OK;
+}
+
+/* st_decompose() converts values below this with SIMD kernels.
+ * Below it doubles have a fractional part, so quotients are exact
+ * integers that convert to uint64 by adding then subtracting it.
+ */
+#define DECOMPOSE_MAGIC 0x1p52
+
+/* Units selected by a st_fmtflags, for st_decompose()'s kernels */
+typedef struct unitsel {
+	uint_fast8_t n, i[ST_NUNITS]; /* Number selected, their indices */
+	double secs[ST_NUNITS], inv[ST_NUNITS]; /* Lengths and reciprocals */
+} unitsel;
+
+/* Decomposes secs[k], setting its counts and remainder in dst.
+ * Exact for any value: for every unit but the last, the remainder is
+ * fmod()'s and the count is the exact quotient, so this is also the
+ * reference for the SIMD kernels.
+ */
+static bool decompose1(const double *secs, size_t k, const unitsel *u,
+		const st_parts *dst)
+{
+	double s = secs[k];
+	if (!(s >= 0) || !isfinite(s)) {
+		for (uint_fast8_t j = 0; j+1 < u->n; j++)
+			dst->counts[u->i[j]][k] = 0;
+		dst->rem[k] = NAN;
+		return false;
+	}
+	bool ok = true;
+	for (uint_fast8_t j = 0; j+1 < u->n; j++) {
+		double r = fmod(s, u->secs[j]);
+		double q = nearbyint((s - r) / u->secs[j]);
+		if (q >= 0x1p64)
+			q = 0x1p64 - 0x1p11 /* Largest double < 2^64 */, ok = false;
+		dst->counts[u->i[j]][k] = q;
+		s = r;
+	}
+	dst->rem[k] = s / u->secs[u->n-1];
+	return ok;
+}
+
+static bool decompose_scalar(const double *secs, size_t lo, size_t hi,
+		const unitsel *u, const st_parts *dst)
+{
+	bool ok = true;
+	for (size_t k = lo; k < hi; k++)
+		ok &= decompose1(secs, k, u, dst);
+	return ok;
+}
+
+#ifdef HAVE_X86_SIMD
+/* Both kernels compute q = floor(s/u) by multiplying by the reciprocal,
+ * correct q by one if the reciprocal's rounding made s - q*u fall
+ * outside [0, u), then compute the remainder r = s - q*u exactly.
+ * That gives the same q and r as decompose1().
+ */
+
+__attribute__((target("avx2,fma")))
+static bool decompose_avx2(const double *secs, size_t lo, size_t hi,
+		const unitsel *u, const st_parts *dst)
+{
+	const __m256d magic = _mm256_set1_pd(DECOMPOSE_MAGIC),
+		      zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1);
+	bool ok = true;
+	size_t k = lo;
+	for (; k+4 <= hi; k += 4) {
+		__m256d s = _mm256_loadu_pd(secs+k);
+		/* Scalar fallback for negative, NaN, huge or infinite values */
+		__m256d inrange = _mm256_and_pd(
+			_mm256_cmp_pd(s, zero, _CMP_GE_OQ),
+			_mm256_cmp_pd(s, magic, _CMP_LT_OQ));
+		if (_mm256_movemask_pd(inrange) != 0xF) {
+			ok &= decompose_scalar(secs, k, k+4, u, dst);
+			continue;
+		}
+		for (uint_fast8_t j = 0; j+1 < u->n; j++) {
+			__m256d us = _mm256_set1_pd(u->secs[j]);
+			__m256d q = _mm256_floor_pd(
+				_mm256_mul_pd(s, _mm256_set1_pd(u->inv[j])));
+			__m256d r = _mm256_fnmadd_pd(q, us, s);
+			q = _mm256_sub_pd(q, _mm256_and_pd(one,
+				_mm256_cmp_pd(r, zero, _CMP_LT_OQ)));
+			q = _mm256_add_pd(q, _mm256_and_pd(one,
+				_mm256_cmp_pd(r, us, _CMP_GE_OQ)));
+			r = _mm256_fnmadd_pd(q, us, s);
+
+			__m256i n = _mm256_sub_epi64(
+				_mm256_castpd_si256(_mm256_add_pd(q, magic)),
+				_mm256_castpd_si256(magic));
+			_mm256_storeu_si256(
+				(__m256i *)(dst->counts[u->i[j]]+k), n);
+			s = r;
+		}
+		_mm256_storeu_pd(dst->rem+k, _mm256_div_pd(s,
+			_mm256_set1_pd(u->secs[u->n-1])));
+	}
+	return decompose_scalar(secs, k, hi, u, dst) && ok;
+}
+
+/* Splits a into hi + lo with 26 significant bits each (Veltkamp) */
+__attribute__((target("sse2")))
+static inline void split_sse2(__m128d a, __m128d *hi, __m128d *lo)
+{
+	__m128d t = _mm_mul_pd(a, _mm_set1_pd(0x1p27 + 1));
+	*hi = _mm_sub_pd(t, _mm_sub_pd(t, a));
+	*lo = _mm_sub_pd(a, *hi);
+}
+
+/* Returns s - q*u, exact if representable, without FMA:
+ * q*u = ph + pl exactly by Dekker's product, and s - ph is exact.
+ */
+__attribute__((target("sse2")))
+static inline __m128d mulsub_sse2(__m128d s, __m128d q, __m128d u)
+{
+	__m128d qh, ql, uh, ul;
+	split_sse2(q, &qh, &ql), split_sse2(u, &uh, &ul);
+	__m128d ph = _mm_mul_pd(q, u);
+	__m128d pl = _mm_add_pd(_mm_add_pd(_mm_add_pd(
+		_mm_sub_pd(_mm_mul_pd(qh, uh), ph),
+		_mm_mul_pd(qh, ul)), _mm_mul_pd(ql, uh)),
+		_mm_mul_pd(ql, ul));
+	return _mm_sub_pd(_mm_sub_pd(s, ph), pl);
+}
+
+__attribute__((target("sse2")))
+static bool decompose_sse2(const double *secs, size_t lo, size_t hi,
+		const unitsel *u, const st_parts *dst)
+{
+	const __m128d magic = _mm_set1_pd(DECOMPOSE_MAGIC),
+		      zero = _mm_setzero_pd(), one = _mm_set1_pd(1);
+	bool ok = true;
+	size_t k = lo;
+	for (; k+2 <= hi; k += 2) {
+		__m128d s = _mm_loadu_pd(secs+k);
+		__m128d inrange = _mm_and_pd(_mm_cmpge_pd(s, zero),
+			_mm_cmplt_pd(s, magic));
+		if (_mm_movemask_pd(inrange) != 0x3) {
+			ok &= decompose_scalar(secs, k, k+2, u, dst);
+			continue;
+		}
+		for (uint_fast8_t j = 0; j+1 < u->n; j++) {
+			__m128d us = _mm_set1_pd(u->secs[j]);
+			/* floor() by rounding to integer and correcting */
+			__m128d x = _mm_mul_pd(s, _mm_set1_pd(u->inv[j]));
+			__m128d q = _mm_sub_pd(_mm_add_pd(x, magic), magic);
+			q = _mm_sub_pd(q, _mm_and_pd(_mm_cmpgt_pd(q, x), one));
+
+			__m128d r = mulsub_sse2(s, q, us);
+			q = _mm_sub_pd(q, _mm_and_pd(_mm_cmplt_pd(r, zero), one));
+			q = _mm_add_pd(q, _mm_and_pd(_mm_cmpge_pd(r, us), one));
+			r = mulsub_sse2(s, q, us);
+
+			__m128i n = _mm_sub_epi64(
+				_mm_castpd_si128(_mm_add_pd(q, magic)),
+				_mm_castpd_si128(magic));
+			_mm_storeu_si128(
+				(__m128i *)(dst->counts[u->i[j]]+k), n);
+			s = r;
+		}
+		_mm_storeu_pd(dst->rem+k, _mm_div_pd(s,
+			_mm_set1_pd(u->secs[u->n-1])));
+	}
+	return decompose_scalar(secs, k, hi, u, dst) && ok;
+}
+#endif
+
+st_err st_decompose(const double *secs, size_t n, st_fmtflags fmt,
+		const st_parts *dst, st_kernel kernel)
+{
+	unitsel u = {0};
+	for (uint_fast8_t i = 0; i < ST_NUNITS; i++)
+		if (fmtflags_get(fmt, i)) {
+			u.i[u.n] = i;
+			u.secs[u.n] = st_units[i].secs;
+			u.inv[u.n] = 1 / u.secs[u.n];
+			u.n++;
+		}
+	if (!u.n)
+		return ST_OK;
+
+#ifdef HAVE_X86_SIMD
+	if (kernel == ST_KERNEL_AUTO) {
+		__builtin_cpu_init();
+		kernel = __builtin_cpu_supports("avx2")
+			&& __builtin_cpu_supports("fma") ? ST_KERNEL_AVX2
+			: __builtin_cpu_supports("sse2") ? ST_KERNEL_SSE2
+			: ST_KERNEL_SCALAR;
+	}
+	bool ok = kernel == ST_KERNEL_AVX2 ? decompose_avx2(secs, 0, n, &u, dst)
+		: kernel == ST_KERNEL_SSE2 ? decompose_sse2(secs, 0, n, &u, dst)
+		: decompose_scalar(secs, 0, n, &u, dst);
+#else
+	(void)kernel;
+	bool ok = decompose_scalar(secs, 0, n, &u, dst);
+#endif
+	return ok ? ST_OK : ST_ERANGE;
+}
@@ -0,0 +1,245 @@
+#ifndef RING_H
+#define RING_H
+
+/* Lock-free single-producer single-consumer rings in shared memory, by
+ * which processes on the same host have secondtime --shm convert for them
+ * without a syscall per request while both sides keep busy. Linux only,
+ * for futex(2). Define _DEFAULT_SOURCE before including any header.
+ *
+ * secondtime creates a region of lanes, each a ring of requests to it and
+ * a ring of responses back, and a worker thread per lane. A producer
+ * takes a lane with ring_attach(), fills a slot of its requests with
+ * ring_claim() and publishes it with ring_push(). The lane's worker
+ * answers requests in order, in slots of responses the producer reads
+ * with ring_peek() and gives back with ring_pop(). Either side polls an
+ * empty or full ring upto RING_SPIN times, then sleeps until the other
+ * wakes it. A producer must read every response before ring_detach().
+ *
+ *     ring_region *r = ring_open("/secondtime");
+ *     ring_lane *l = r ? ring_attach(r) : NULL;
+ *     ring_slot *s = l ? ring_claim_wait(&l->req, &r->stop) : NULL;
+ *     if (s) {
+ *             *s = (ring_slot){.op = RING_S2STR, .flags = fmt, .secs = 5400};
+ *             ring_push(&l->req);
+ *             if ((s = ring_peek_wait(&l->res, &r->stop))) {
+ *                     if (s->op == ST_OK)
+ *                             printf("%.*s\n", s->len, s->text);
+ *                     ring_pop(&l->res);
+ *             }
+ *     }
+ */
+
+#include <limits.h> /* INT_MAX */
+#include <stdbool.h> /* bool */
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint8_t, uint16_t, uint32_t */
+#include <time.h>   /* struct timespec */
+#include <fcntl.h>  /* O_RDWR */
+#include <unistd.h> /* syscall, close */
+#include <sched.h>  /* sched_yield */
+#include <sys/mman.h>    /* shm_open, mmap, munmap */
+#include <sys/stat.h>    /* fstat */
+#include <sys/syscall.h> /* SYS_futex */
+#include <linux/futex.h> /* FUTEX_WAIT, FUTEX_WAKE */
+
+#define RING_MAGIC   0x47525453 /* "STRG" */
+#define RING_VERSION 1
+
+/* Slots of each ring, a power of 2 */
+#define RING_SLOTS 256
+/* Chars of a slot's text, at least ST_S2STR_MAX */
+#define RING_TEXT  240
+/* Polls of a ring before sleeping, yielding the CPU every RING_YIELD polls
+ * in case the other side is waiting for it, and longest sleep before
+ * polling again.
+ */
+#define RING_SPIN  2048
+#define RING_YIELD 64
+#define RING_NAP   50000000 /* ns */
+
+/* What a request asks for */
+typedef enum ring_op {
+	RING_S2STR, /* secs in units of fmtflags, st_s2str() */
+	RING_STR2S  /* text in seconds, st_str2s() */
+} ring_op;
+
+typedef struct ring_slot {
+	uint32_t id;    /* Anything, copied from a request to its response */
+	uint8_t op;     /* ring_op of a request, st_err of its response */
+	uint8_t flags;  /* st_fmtflags of RING_S2STR, or st_str2s() flags */
+	uint16_t len;   /* Chars of text */
+	double secs;    /* To format, or parsed */
+	char text[RING_TEXT]; /* To parse, or formatted, not NUL-terminated */
+} ring_slot;
+
+/* Fields are grouped by the side that writes them, on separate cache
+ * lines, each side keeping the other's index as last seen to read the
+ * other's line only when its own ring seems empty or full.
+ */
+typedef struct ring {
+	_Alignas(64) uint32_t head; /* Slots popped, by the consumer */
+	uint32_t popwait;  /* Consumer is asleep on tail */
+	uint32_t tailseen; /* By the consumer */
+	_Alignas(64) uint32_t tail; /* Slots pushed, by the producer */
+	uint32_t pushwait; /* Producer is asleep on head */
+	uint32_t headseen; /* By the producer */
+	_Alignas(64) ring_slot slots[RING_SLOTS];
+} ring;
+
+typedef struct ring_lane {
+	uint32_t taken; /* By a producer */
+	ring req, res;
+} ring_lane;
+
+/* Set up by secondtime before it sets magic, which producers check.
+ * secondtime holds an flock() on it for as long as it serves it.
+ */
+typedef struct ring_region {
+	uint32_t magic, version;
+	uint32_t nlanes;
+	uint32_t stop; /* secondtime stopped serving */
+	ring_lane lanes[];
+} ring_region;
+
+static inline size_t ring_region_size(uint32_t nlanes)
+{
+	return sizeof(ring_region) + nlanes*sizeof(ring_lane);
+}
+
+static inline void ring_relax(unsigned spins)
+{
+	if (spins % RING_YIELD == RING_YIELD-1)
+		sched_yield();
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ volatile ("yield");
+#endif
+}
+
+/* Sleeps while *word is val, at most RING_NAP, having set *waiting so the
+ * other side wakes it once it changes *word.
+ */
+static inline void ring_sleep(uint32_t *word, uint32_t val, uint32_t *waiting)
+{
+	const struct timespec nap = {.tv_nsec = RING_NAP};
+	__atomic_store_n(waiting, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(word, __ATOMIC_RELAXED) == val)
+		syscall(SYS_futex, word, FUTEX_WAIT, val, &nap, NULL, 0);
+	__atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+}
+
+/* Wakes the other side if it's asleep on word, which was just changed */
+static inline void ring_wake(uint32_t *word, uint32_t *waiting)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(waiting, __ATOMIC_RELAXED))
+		syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/* Next slot of q to fill, or NULL if q is full. By the producer. */
+static inline ring_slot *ring_claim(ring *q)
+{
+	if (q->tail - q->headseen == RING_SLOTS && q->tail - (q->headseen =
+			__atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) == RING_SLOTS)
+		return NULL;
+	return &q->slots[q->tail % RING_SLOTS];
+}
+
+/* Publishes the slot of q from ring_claim() to the consumer */
+static inline void ring_push(ring *q)
+{
+	__atomic_store_n(&q->tail, q->tail+1, __ATOMIC_RELEASE);
+	ring_wake(&q->tail, &q->popwait);
+}
+
+/* Next slot of q to read, or NULL if q is empty. By the consumer. */
+static inline ring_slot *ring_peek(ring *q)
+{
+	if (q->head == q->tailseen && q->head == (q->tailseen =
+			__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE)))
+		return NULL;
+	return &q->slots[q->head % RING_SLOTS];
+}
+
+/* Gives the slot of q from ring_peek() back to the producer */
+static inline void ring_pop(ring *q)
+{
+	__atomic_store_n(&q->head, q->head+1, __ATOMIC_RELEASE);
+	ring_wake(&q->head, &q->pushwait);
+}
+
+/* Like ring_claim(), but waits while q is full, until *stop is set */
+static inline ring_slot *ring_claim_wait(ring *q, const uint32_t *stop)
+{
+	ring_slot *s;
+	for (unsigned spins = 0; !(s = ring_claim(q)); spins++)
+		if (__atomic_load_n(stop, __ATOMIC_ACQUIRE))
+			break;
+		else if (spins < RING_SPIN)
+			ring_relax(spins);
+		else
+			ring_sleep(&q->head, q->headseen, &q->pushwait);
+	return s;
+}
+
+/* Like ring_peek(), but waits while q is empty, until *stop is set */
+static inline ring_slot *ring_peek_wait(ring *q, const uint32_t *stop)
+{
+	ring_slot *s;
+	for (unsigned spins = 0; !(s = ring_peek(q)); spins++)
+		if (__atomic_load_n(stop, __ATOMIC_ACQUIRE))
+			break;
+		else if (spins < RING_SPIN)
+			ring_relax(spins);
+		else
+			ring_sleep(&q->tail, q->tailseen, &q->popwait);
+	return s;
+}
+
+/* Maps the region secondtime --shm serves at name, NULL on error */
+static inline ring_region *ring_open(const char *name)
+{
+	ring_region *r = NULL;
+	struct stat st;
+	int fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0)
+		return NULL;
+	if (!fstat(fd, &st) && (size_t)st.st_size >= sizeof(*r)
+			&& (r = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED, fd, 0)) == MAP_FAILED)
+		r = NULL;
+	close(fd);
+	if (r && (__atomic_load_n(&r->magic, __ATOMIC_ACQUIRE) != RING_MAGIC
+			|| r->version != RING_VERSION
+			|| (size_t)st.st_size < ring_region_size(r->nlanes))) {
+		munmap(r, st.st_size);
+		r = NULL;
+	}
+	return r;
+}
+
+static inline void ring_close(ring_region *r)
+{
+	munmap(r, ring_region_size(r->nlanes));
+}
+
+/* Takes a lane of r no other producer has, NULL if there's none */
+static inline ring_lane *ring_attach(ring_region *r)
+{
+	for (uint32_t i = 0; i < r->nlanes; i++) {
+		uint32_t free = 0;
+		if (__atomic_compare_exchange_n(&r->lanes[i].taken, &free, 1,
+				false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return &r->lanes[i];
+	}
+	return NULL;
+}
+
+static inline void ring_detach(ring_lane *l)
+{
+	__atomic_store_n(&l->taken, 0, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -1,9 +1,9 @@
 #ifndef SBOMGA_H
 #define SBOMGA_H
 
-#include <stdbool.h> /* bool, true, false */
-#include <stddef.h>  /* size_t            */
-#include <limits.h>  /* CHAR_BIT          */
+#include <stdbool.h> /* bool, true, false   */
+#include <stddef.h>  /* size_t, max_align_t */
+#include <limits.h>  /* CHAR_BIT            */
 
 #ifndef SIZE_MAX
 #define SIZE_MAX ((size_t)-1)
@@ -40,6 +40,10 @@
  *   - name_maxcap, the maxmimum number of elements.
  *   - name_realloc, name_free; aliases of reallocfn(),freefn().
  *
+ * - Member variables :
+ *   - name_nallocs, the number of successful calls to reallocfn()
+ *     made by this thread, to verify code doesn't allocate in loops.
+ *
  * - Member functions :
  *   - name_arr()
  *   - name_cap()
@@ -92,6 +96,7 @@ scope void name##_shrink_to_fit(name *);                                      \
 #define SBOMGA_DEF(scope, name, reallocfn, freefn)                            \
 static void *(*const name##_realloc)(void *, size_t) = reallocfn;             \
 static void (*const name##_free)(void *) = freefn;                            \
+static _Thread_local unsigned long name##_nallocs;                            \
 									      \
 scope name##_eltype *name##_arr(const name *foo)                              \
 {                                                                             \
@@ -120,7 +125,7 @@ scope name name##_create(size_t n)                                            \
 	name res = { .big = n > name##_sbocap };                              \
 	if (res.big && n <= name##_maxcap       	                      \
 			   && (res.arr = name##_realloc(NULL, n*elsz)))       \
-		res.cap = n;                                                  \
+		res.cap = n, name##_nallocs++;                                \
 	return res;                                                           \
 }                                                                             \
 									      \
@@ -155,6 +160,7 @@ scope bool name##_reserve(name *foo, size_t n)                                \
 					foo->big = true;                      \
 				foo->arr = p;                                 \
 				foo->cap = newcap;                            \
+				name##_nallocs++;                             \
 			} else                                                \
 				return false;                                 \
 		}                                                             \
@@ -247,7 +253,8 @@ scope void name##_shrink_to_fit(name *foo)                                    \
 		} else {                                                      \
 			void *p = name##_realloc(foo->arr, len*elsz);         \
 			if (p)                                                \
-				foo->arr = p, foo->cap = len;                 \
+				foo->arr = p, foo->cap = len,                 \
+				name##_nallocs++;                             \
 	       }                                                              \
 	}                                                                     \
 }                                                                             \
@@ -256,5 +263,121 @@ scope void name##_shrink_to_fit(name *foo)                                    \
 SBOMGA_DECL(static inline, name, sbocap, __VA_ARGS__)                         \
 SBOMGA_DEF(static inline, name, reallocfn, freefn)
 
+#include <stdlib.h>  /* malloc(), free() */
+
+/* Expands a thread-local bump allocator with given name, that takes memory
+ * from malloc() in blocks of at least blocksz bytes, to pass as the
+ * reallocfn and freefn of instantiations whose arrays all die together,
+ * like the buffers of values in a batch.
+ *
+ * Example : SBOMGA_ARENA_IMPL(arena, 1 << 16)
+ *           SBOMGA_IMPL(str, arena_realloc, arena_free, 48, char)
+ *
+ * Allocation just bumps a pointer, and growing or freeing the latest
+ * allocation is done in place. Other frees are no-ops, until
+ * name_reset() frees everything allocated by this thread at once.
+ * It then keeps the memory, merged into one block if it spanned many,
+ * so a thread that resets after each batch stops calling malloc()
+ * once it has seen its largest batch.
+ *
+ * - Member functions :
+ *   - name_realloc(), name_free(); follow stdlib realloc/free's ABI.
+ *   - name_reset(), invalidates all of this thread's allocations.
+ *   - name_release(), like name_reset() but frees the memory too.
+ *     Call it before a thread exits to not leak its memory.
+ *
+ * - Member variables :
+ *   - name_nblocks, the number of blocks malloc()'d by this thread.
+ */
+#define SBOMGA_ARENA_IMPL(name, blocksz)                                      \
+typedef struct name##_block {                                                 \
+	struct name##_block *prev;                                            \
+	size_t cap, used;                                                     \
+} name##_block;                                                               \
+									      \
+/* Each allocation is preceded by its size, in a slot of this many bytes */   \
+enum { name##_align = _Alignof(max_align_t) };                                \
+static const size_t name##_hdr =                                              \
+	(sizeof(name##_block) + name##_align-1) / name##_align*name##_align;  \
+									      \
+static _Thread_local name##_block *name##_top;                                \
+static _Thread_local unsigned long name##_nblocks;                            \
+									      \
+static inline char *name##_data(name##_block *b)                              \
+{                                                                             \
+	return (char *)b + name##_hdr;                                        \
+}                                                                             \
+									      \
+static inline size_t *name##_size(void *p)                                    \
+{                                                                             \
+	return (size_t *)((char *)p - name##_align);                          \
+}                                                                             \
+									      \
+/* Pushes a new block with room for at least n bytes, returning success */    \
+static inline bool name##_grow(size_t n)                                      \
+{                                                                             \
+	size_t cap = SBOMGA_MAX((size_t)(blocksz), n);                        \
+	name##_block *b = cap <= SIZE_MAX-name##_hdr ?                        \
+		malloc(name##_hdr + cap) : NULL;                              \
+	if (b) {                                                              \
+		*b = (name##_block){name##_top, cap, 0};                      \
+		name##_top = b, name##_nblocks++;                             \
+	}                                                                     \
+	return b;                                                             \
+}                                                                             \
+									      \
+static inline void *name##_realloc(void *p, size_t n)                         \
+{                                                                             \
+	enum { a = name##_align };                                            \
+	if (n > SIZE_MAX - 2*a)                                               \
+		return NULL;                                                  \
+	n = (SBOMGA_MAX(n, 1) + a-1) / a*a;                                   \
+									      \
+	name##_block *b = name##_top;                                         \
+	size_t old = p ? *name##_size(p) : 0;                                 \
+	if (old >= n)                                                         \
+		return p;                                                     \
+	else if (p && (char *)p + old == name##_data(b) + b->used             \
+			&& b->cap - b->used >= n-old) { /* Latest, grow it */ \
+		b->used += n-old, *name##_size(p) = n;                        \
+		return p;                                                     \
+	}                                                                     \
+									      \
+	if ((!b || b->cap - b->used < a+n) && !name##_grow(a+n))              \
+		return NULL;                                                  \
+	b = name##_top;                                                       \
+	char *q = name##_data(b) + b->used + a;                               \
+	b->used += a+n, *name##_size(q) = n;                                  \
+	if (p)                                                                \
+		memcpy(q, p, old);                                            \
+	return q;                                                             \
+}                                                                             \
+									      \
+static inline void name##_free(void *p)                                       \
+{                                                                             \
+	name##_block *b = name##_top;                                         \
+	if (p && (char *)p + *name##_size(p) == name##_data(b) + b->used)     \
+		b->used -= name##_align + *name##_size(p);                    \
+}                                                                             \
+									      \
+static inline void name##_reset(void)                                         \
+{                                                                             \
+	name##_block *b = name##_top;                                         \
+	if (b && b->prev) { /* Merge into one block of the same capacity */   \
+		size_t cap = 0;                                               \
+		for (name##_block *prev; b; b = prev)                         \
+			prev = b->prev, cap += b->cap, free(b);               \
+		name##_top = NULL;                                            \
+		name##_grow(cap);                                             \
+	} else if (b)                                                         \
+		b->used = 0;                                                  \
+}                                                                             \
+									      \
+static inline void name##_release(void)                                       \
+{                                                                             \
+	for (name##_block *prev; name##_top; name##_top = prev)               \
+		prev = name##_top->prev, free(name##_top);                    \
+}
+
 #endif
 #endif
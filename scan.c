@@ -0,0 +1,117 @@
+#include <stdbool.h> /* bool */
+#include <stdint.h>  /* uint64_t */
+#include <string.h>  /* memcpy, strlen */
+
+#ifdef __SSE2__
+#define HAVE_SSE2 1
+#include <emmintrin.h> /* _mm_* */
+#endif
+
+#include "scan.h"
+
+static inline int isdigit_(unsigned char c)
+{
+	return (unsigned)c - '0' < 10;
+}
+
+const char *scan_digit(const char *p, const char *end)
+{
+#ifdef HAVE_SSE2
+	/* Digits are the bytes that subtracting '0' leaves at most 9 */
+	const __m128i zero = _mm_set1_epi8('0'), nine = _mm_set1_epi8(9);
+	for (; end-p >= 16; p += 16) {
+		__m128i t = _mm_sub_epi8(_mm_loadu_si128((const void *)p), zero);
+		int mask = _mm_movemask_epi8(
+				_mm_cmpeq_epi8(_mm_min_epu8(t, nine), t));
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+#else
+	/* XOR with '0' leaves only digits below 10, then find any such byte
+	 * of a word with the has-less-than bit trick. It can only err on the
+	 * side of a false positive past a true one, so rescan the word.
+	 */
+	const uint64_t ones = UINT64_MAX/255;
+	for (; end-p >= 8; p += 8) {
+		uint64_t w;
+		memcpy(&w, p, sizeof(w));
+		w ^= ones*'0';
+		if ((w - ones*10) & ~w & ones*0x80)
+			break;
+	}
+#endif
+	while (p < end && !isdigit_(*p))
+		p++;
+	return p;
+}
+
+const char *scan_either(const char *p, const char *end, char a, char b)
+{
+#ifdef HAVE_SSE2
+	const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+	for (; end-p >= 16; p += 16) {
+		__m128i t = _mm_loadu_si128((const void *)p);
+		int mask = _mm_movemask_epi8(_mm_or_si128(
+				_mm_cmpeq_epi8(t, va), _mm_cmpeq_epi8(t, vb)));
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+#else
+	/* XOR with a or b zeroes the bytes equal to it, then find a zero
+	 * byte with the same trick and rescan as scan_digit() does.
+	 */
+	const uint64_t ones = UINT64_MAX/255;
+	const uint64_t wa = ones*(unsigned char)a, wb = ones*(unsigned char)b;
+	for (; end-p >= 8; p += 8) {
+		uint64_t w;
+		memcpy(&w, p, sizeof(w));
+		uint64_t xa = w ^ wa, xb = w ^ wb;
+		if (((xa - ones) & ~xa & ones*0x80)
+				| ((xb - ones) & ~xb & ones*0x80))
+			break;
+	}
+#endif
+	while (p < end && *p != a && *p != b)
+		p++;
+	return p;
+}
+
+const char *scan_suffixed(const char *p, const char *end, const char *set)
+{
+	const size_t nset = strlen(set);
+#ifdef HAVE_SSE2
+	/* Digits of a block where the block a byte on has a char of set, or
+	 * a dot and the block two bytes on has one.
+	 */
+	const __m128i zero = _mm_set1_epi8('0'), nine = _mm_set1_epi8(9);
+	const __m128i dot = _mm_set1_epi8('.');
+	__m128i vs[SCAN_SET_MAX];
+	for (size_t i = 0; i < nset; i++)
+		vs[i] = _mm_set1_epi8(set[i]);
+	for (; end-p >= 18; p += 16) {
+		__m128i t = _mm_sub_epi8(_mm_loadu_si128((const void *)p), zero);
+		__m128i digits = _mm_cmpeq_epi8(_mm_min_epu8(t, nine), t);
+		if (!_mm_movemask_epi8(digits))
+			continue;
+		__m128i n1 = _mm_loadu_si128((const void *)(p+1));
+		__m128i n2 = _mm_loadu_si128((const void *)(p+2));
+		__m128i s1 = _mm_setzero_si128(), s2 = _mm_setzero_si128();
+		for (size_t i = 0; i < nset; i++) {
+			s1 = _mm_or_si128(s1, _mm_cmpeq_epi8(n1, vs[i]));
+			s2 = _mm_or_si128(s2, _mm_cmpeq_epi8(n2, vs[i]));
+		}
+		s1 = _mm_or_si128(s1, _mm_and_si128(_mm_cmpeq_epi8(n1, dot), s2));
+		int mask = _mm_movemask_epi8(_mm_and_si128(digits, s1));
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+#endif
+	bool inset[256] = {0};
+	for (size_t i = 0; i < nset; i++)
+		inset[(unsigned char)set[i]] = true;
+	for (; (p = scan_digit(p, end)) < end; p++)
+		if ((end-p > 1 && inset[(unsigned char)p[1]]) || (end-p > 2
+				&& p[1] == '.' && inset[(unsigned char)p[2]]))
+			return p;
+	return end;
+}
@@ -0,0 +1,21 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+/* Fast searches over bytes of text, many bytes at a time */
+
+/* Returns a pointer to the first ASCII digit in [p, end), or end if none */
+const char *scan_digit(const char *p, const char *end);
+
+/* Returns a pointer to the first a or b in [p, end), or end if none */
+const char *scan_either(const char *p, const char *end, char a, char b);
+
+/* Most chars of the set of scan_suffixed() */
+#define SCAN_SET_MAX 8
+
+/* Returns a pointer to the first ASCII digit in [p, end) followed by one of
+ * the upto SCAN_SET_MAX chars of NUL-terminated set, right after it or
+ * after a dot, or end if none
+ */
+const char *scan_suffixed(const char *p, const char *end, const char *set);
+
+#endif
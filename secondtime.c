@@ -1,219 +1,1035 @@
-#include <math.h>   /* NAN, fmodl, isfinite, isnan */
-#include <float.h>  /* DECIMAL_DIG */
-#include <stdio.h>  /* stderr, snprintf, sprintf, fprintf, printf */
-#include <errno.h>  /* errno, ERANGE */
-#include <stdlib.h> /* exit, EXIT_FAILURE, EXIT_SUCCESS, realloc, free */
-#include <stdint.h> /* uint_least32_t, uint_least8_t, uint_fast8_t,
-                     * uintmax_t, int_fast8_t */
-#include <ctype.h>  /* isspace */
-
-#include "sbomga.h" /* github.com/a-p-jo/darc/blob/main/sbomga/sbomga.h */
-SBOMGA_IMPL(str, realloc, free, 0, char) /* Dynamic SSO string */
-
-#include "config.h" /* Exports SELECTED_YEAR, HOW_TO_PRINT_FLOATS */
-
-#if SELECTED_YEAR == NORMAL_YEAR
-#define SECS_IN_YR 31536000.0L
-#elif SELECTED_YEAR == LEAP_YEAR
-#define SECS_IN_YR 31622400.0L
-#elif SELECTED_YEAR == JULIAN_YEAR
-#define SECS_IN_YR 31557600.0L
-#elif SELECTED_YEAR == GREGORIAN_YEAR
-#define SECS_IN_YR 31556952.0L
-#elif SELECTED_YEAR == TROPICAL_YEAR
-#define SECS_IN_YR 31556925.216L
-#elif SELECTED_YEAR == SIDEREAL_YEAR
-#define SECS_IN_YR 31558149.7635L
-#else
-#error "Invalid value for SELECTED_YEAR in config.h"
+#define _DEFAULT_SOURCE /* madvise() */
+
+#include <stdio.h>  /* stderr, fprintf, printf, fread, fwrite */
+#include <stdlib.h> /* EXIT_FAILURE, EXIT_SUCCESS, realloc, free, strtoul */
+#include <string.h> /* strcmp, strlen, memchr, memmove */
+
+#include "cli.h"   /* str, BAD_LINE, st_*, cache_*, modes in other files */
+#include "scan.h"  /* scan_* */
+
+#ifdef HAVE_POSIX
+#include <fcntl.h>    /* open, O_RDONLY */
+#include <unistd.h>   /* close */
+#include <sys/stat.h> /* fstat */
+#include <sys/mman.h> /* mmap, munmap, madvise */
+#include <sys/uio.h>  /* writev, struct iovec */
+#include <pthread.h>  /* pthread_* */
+#include <errno.h>    /* errno, EINTR */
 #endif
 
-typedef struct tm_unit {
-	long double secs;
-	char sfx;
-} tm_unit;
-
-static const tm_unit tm_units[] = {
-	{SECS_IN_YR   , 'y'},
-	{SECS_IN_YR/12, 'M'},
-	{604800       , 'w'},
-	{86400        , 'd'},
-	{3600         , 'h'},
-	{60           , 'm'},
-	{1            , 's'}
-};
-
-/* s2str() format flag bits: Bit i corresponds to tm_units[i]. */
-typedef uint_least8_t fmtflags;
-static const fmtflags fmtflags_all0 = 0;
-static const fmtflags fmtflags_all1 = ~fmtflags_all0;
-
-/* i < bits in fmtflags */
-static inline bool fmtflags_get(fmtflags x, uint_fast8_t i)
-{
-	return x & (1 << i);
-}
-/* x is never NULL */
-static inline void fmtflags_set(fmtflags *x, uint_fast8_t i)
-{
-	*x = *x | (1 << i);
-}
-static inline bool fmtflags_anysetafter(fmtflags x, uint_fast8_t i)
-{
-	/* EXPLANATION:
-	 * Say the low 7 bits of x are 0010100.
-	 * We want to check if any bits after the 3rd bit are set (i=2).
-	 * (1 << 3) gives 0001000.
-	 * (1 << 3)-1 gives 0000111.
-	 * ~((1 << 3)-1) gives 1111000.
-	 * when we bitwise AND this with x:
-	 * All bits until (and including) i are set to 0 (1&0 = 0, 0&0 = 0).
-	 * All bits thereafter are unchanged because (0&1 = 0, 1&1 = 1).
-	 * The resulting value, if any bits were after i were set,
-	 * will evaluate to true when converted to bool.
-	 */
-	return x & ~((1 << (i+1)) - 1);
-	
-}
-
-#define LEN(x) (sizeof(x)/sizeof(x[0]))
-
-/* https://stackoverflow.com/a/24487623 */
-#define STUPID_TOSTR(X) #X
-#define TOSTR(X) STUPID_TOSTR(X)
-
-/* About %g: https://stackoverflow.com/a/54162153/13651625
- * About DECIMAL_DIG: https://stackoverflow.com/a/19897395
+/* Capacity convert_line() needs past dst->len never to reallocate */
+#define CONVERT_MAX (ST_S2STR_MAX > ST_LDTOA_MAX+1 ? ST_S2STR_MAX \
+		: ST_LDTOA_MAX+1)
+
+/* Converts line of len chars like main() converts argv[1],
+ * appending the result to dst.
+ *
+ * Returns true on success or false for invalid input or reallocation
+ * errors (in which case dst's contents past its original length are
+ * indeterminate).
+ */
+static bool convert_line(const char *line, size_t len, st_fmtflags fmt,
+		str *dst)
+{
+	long double s;
+	st_err err = STATS_ST(STAGE_NUM2S, st_num2s(line, len, &s));
+	if (err == ST_EINVAL) { /* Not numerical, may be in time units */
+		if (STATS_ST(STAGE_STR2S, st_str2s(line, len, 0, &s, NULL))
+				|| !str_reserve(dst, dst->len + ST_LDTOA_MAX+1))
+			return false;
+		size_t n;
+		char *p = str_arr(dst)+dst->len;
+		STATS_ST(STAGE_LDTOA, st_ldtoa(s, p, ST_LDTOA_MAX, &n));
+		p[n++] = 's', p[n] = '\0';
+		dst->len += n;
+		return true;
+	} else if (err || !str_reserve(dst, dst->len + ST_S2STR_MAX))
+		return false;
+
+	size_t n;
+	STATS_ST(STAGE_S2STR,
+		st_s2str(s, fmt, str_arr(dst)+dst->len, ST_S2STR_MAX, &n));
+	dst->len += n;
+	return true;
+}
+
+/* Converts line of len chars to fmt, appending it to dst like convert_line() */
+typedef bool converter(const char *line, size_t len, st_fmtflags fmt,
+		str *dst);
+
+/* Converts line with conv, but looks it up in memo first if it isn't NULL,
+ * and remembers the result there on a miss.
+ */
+static bool convert_cached(const char *line, size_t len, st_fmtflags fmt,
+		cache *memo, converter *conv, str *dst)
+{
+	if (!memo)
+		return conv(line, len, fmt, dst);
+	/* So conv() fails only for invalid input */
+	if (!str_reserve(dst, dst->len + CONVERT_MAX))
+		return false;
+
+	size_t n, oldlen = dst->len;
+	switch (cache_get(memo, line, len, fmt, str_arr(dst)+oldlen, &n)) {
+	case CACHE_HIT:
+		dst->len += n;
+		return true;
+	case CACHE_HIT_BAD:
+		return false;
+	case CACHE_MISS:
+		break;
+	}
+	bool ok = conv(line, len, fmt, dst);
+	cache_put(memo, line, len, fmt, ok ? str_arr(dst)+oldlen : NULL,
+			dst->len - oldlen);
+	return ok;
+}
+
+/* Appends conversion of line of len chars and a newline to dst,
+ * or BAD_LINE if it can't be converted, in which case *allgood is set to
+ * false. memo may be NULL to not cache conversions.
+ *
+ * Returns false only for reallocation errors.
  */
-#if HOW_TO_PRINT_FLOATS == READABLY_PRINT_FLOATS
-#define LDBL_FMTSPEC "%Lg"
-#elif HOW_TO_PRINT_FLOATS == ACCURATELY_PRINT_FLOATS
-#define LDBL_FMTSPEC "%."TOSTR(DECIMAL_DIG)"Lg"
+static bool emit_line(const char *line, size_t len, st_fmtflags fmt,
+		cache *memo, str *dst, bool *allgood)
+{
+	size_t oldlen = dst->len;
+	if (!convert_cached(line, len, fmt, memo, convert_line, dst)) {
+		*allgood = false;
+		dst->len = oldlen;
+		if (!str_insert(dst, dst->len, BAD_LINE, sizeof(BAD_LINE)-1))
+			return false;
+	}
+	return str_insert(dst, dst->len, "\n", 1);
+}
+
+bool convert_lines(const char *beg, const char *end, st_fmtflags fmt,
+		cache *memo, str *dst, bool *allgood)
+{
+	while (beg < end) {
+		const char *nl = memchr(beg, '\n', end-beg);
+		size_t n = (nl ? nl : end) - beg;
+		if (n && beg[n-1] == '\r')
+			n--;
+		if (!emit_line(beg, n, fmt, memo, dst, allgood))
+			return false;
+		beg = nl ? nl+1 : end;
+	}
+	return true;
+}
+
+/* Most entries --cache may be given per thread, 2 GiB of memory */
+#define CACHE_CAP_MAX ((size_t)1 << 24)
+
+void report_cache(cache *const *memos, size_t n)
+{
+	unsigned long long hits = 0, misses = 0;
+	for (size_t i = 0; i < n; i++)
+		hits += cache_hits(memos[i]), misses += cache_misses(memos[i]);
+	fprintf(stderr, "Cache: %llu hits, %llu misses (%.1f%% hit rate).\n",
+		hits, misses, hits+misses ? 100.0*hits/(hits+misses) : 0.0);
+}
+
+const char *fill(str *in, FILE *f, bool *eof, char **end)
+{
+	/* Fill all free space after any incomplete line left over */
+	if (str_cap(in)-in->len < BATCH_INBUF/2
+			&& !str_reserve(in, str_cap(in)*2))
+		return "Out of memory";
+	char *arr = str_arr(in);
+	size_t want = str_cap(in)-in->len;
+	STATS_BEGIN();
+	size_t n = fread(arr+in->len, 1, want, f);
+	STATS_END(STAGE_READ, n < want && ferror(f));
+	if (n < want) {
+		if (ferror(f))
+			return "Couldn't read input";
+		*eof = true;
+	}
+	in->len += n;
+
+	*end = arr+in->len;
+	if (!*eof)
+		while (*end > arr && (*end)[-1] != '\n')
+			--*end;
+	return NULL;
+}
+
+void consume(str *in, const char *end)
+{
+	char *arr = str_arr(in);
+	in->len = arr+in->len - end;
+	memmove(arr, end, in->len);
+}
+
+args_res convert_args(const char *time, size_t len, const char *fmt,
+		st_fmtflags deffmt, char *dst)
+{
+	long double s;
+	st_err err = STATS_ST(STAGE_NUM2S, st_num2s(time, len, &s));
+	if (err == ST_EINVAL) { /* Not numerical, may be in time units */
+		size_t pos;
+		if (fmt)
+			return ARGS_BAD;
+		else if ((err = STATS_ST(STAGE_STR2S,
+				st_str2s(time, len, 0, &s, &pos)))) {
+			sprintf(dst, "%s at char %zu", err == ST_ERANGE ?
+				"Out of range" : "Invalid argument", pos+1);
+			return ARGS_ERR;
+		} else if (STATS_ST(STAGE_LDTOA,
+				st_ldtoa(s, dst, ST_LDTOA_MAX, &len))) {
+			strcpy(dst, "Invalid argument");
+			return ARGS_ERR;
+		}
+		dst[len] = 's', dst[len+1] = '\0';
+		return ARGS_OK;
+	} else if (err) {
+		strcpy(dst, "Argument out of range");
+		return ARGS_ERR;
+	}
+
+	/* Is numerical, convert seconds to time units */
+	st_fmtflags f = deffmt;
+	if (fmt && STATS_ST(STAGE_FMTFLAGS, st_str2fmtflags(&f, fmt)))
+		return ARGS_BAD;
+	else if (STATS_ST(STAGE_S2STR,
+			st_s2str(s, f, dst, ST_S2STR_MAX, NULL))) {
+		strcpy(dst, "Couldn't convert");
+		return ARGS_ERR;
+	}
+	return ARGS_OK;
+}
+
+bool flush(str *buf)
+{
+	size_t n = buf->len;
+	buf->len = 0;
+	STATS_BEGIN();
+	bool ok = fwrite(str_arr(buf), 1, n, stdout) == n;
+	STATS_END(STAGE_WRITE, !ok);
+	return ok;
+}
+
+/* Converts newline-delimited values from stdin to stdout, one per line,
+ * with every numerical value converted to the same format.
+ *
+ * Lines that can't be converted are replaced by BAD_LINE, the rest of the
+ * input is still converted. If cachecap isn't 0, conversions are cached
+ * in a cache of cachecap entries and its hits and misses reported at exit.
+ *
+ * Returns EXIT_SUCCESS if every line was converted, else EXIT_FAILURE.
+ */
+static int batch(st_fmtflags fmt, size_t cachecap)
+{
+	const char *err = NULL;
+	bool allgood = true;
+	str in = str_create(BATCH_INBUF), out = str_create(BATCH_OUTBUF);
+	cache *memo = cachecap ? cache_create(cachecap) : NULL;
+	if (str_cap(&in) < BATCH_INBUF || str_cap(&out) < BATCH_OUTBUF
+			|| (cachecap && !memo)) {
+		err = "Out of memory";
+		goto end;
+	}
+
+	for (bool eof = false; !eof;) {
+		/* Convert complete lines, or all of it at EOF */
+		char *end;
+		if ((err = fill(&in, stdin, &eof, &end)))
+			goto end;
+		if (!convert_lines(str_arr(&in), end, fmt, memo, &out,
+				&allgood)) {
+			err = "Out of memory";
+			goto end;
+		}
+		if (out.len >= BATCH_OUTBUF && !flush(&out)) {
+			err = "Couldn't write output";
+			goto end;
+		}
+		consume(&in, end);
+	}
+	if (!flush(&out) || fflush(stdout))
+		err = "Couldn't write output";
+end:
+	if (err)
+		fprintf(stderr, "Error: %s.\n", err);
+	if (memo)
+		report_cache(&memo, 1);
+	str_destroy(&in), str_destroy(&out), cache_destroy(memo);
+	return allgood && !err ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool isalpha_(unsigned char c)
+{
+	return (unsigned)(c|32) - 'a' < 26;
+}
+
+/* Whether c may be part of a word, which a duration token must not be in */
+static bool isword(unsigned char c)
+{
+	return isalpha_(c) || (unsigned)c - '0' < 10 || c == '.' || c == '_';
+}
+
+/* End of the duration token that may start at p before end,
+ * a run of word chars and signs of exponents, less any trailing dots.
+ */
+static const char *token_end(const char *p, const char *end)
+{
+	const char *q = p;
+	while (++q < end && (isword(*q)
+			|| ((*q == '+' || *q == '-') && (q[-1]|32) == 'e')))
+		;
+	while (q[-1] == '.')
+		q--;
+	return q;
+}
+
+/* Reads duration token tok of len chars into *s: seconds with an s suffix
+ * like "5400s", setting *secs, or time in units like "1h30m". Unlike
+ * st_str2s(), every unit needs a coefficient, so that words like "100ms"
+ * or "5min" aren't taken for durations, and numbers must be decimal, so
+ * that hex like "0x10s" isn't either.
+ *
+ * Returns false if tok isn't a duration.
+ */
+static bool duration_token(const char *tok, size_t len, long double *s,
+		bool *secs)
+{
+	for (size_t i = 0; i < len; i++)
+		if ((tok[i]|32) == 'x'
+				|| (i && isalpha_(tok[i]) && isalpha_(tok[i-1])))
+			return false;
+
+	*secs = len > 1 && tok[len-1] == 's'
+		&& !STATS_ST(STAGE_NUM2S, st_num2s(tok, len-1, s));
+	return *secs || !STATS_ST(STAGE_STR2S,
+		st_str2s(tok, len, ST_STRICT, s, NULL));
+}
+
+/* Converts duration token tok of len chars to the other form, appending
+ * it to dst, which must have room for CONVERT_MAX more chars:
+ * seconds with an s suffix like "5400s" to units selected by fmt,
+ * or time in units like "1h30m" to seconds with an s suffix.
+ *
+ * Returns false if tok isn't a duration or converts to nothing.
+ */
+static bool rewrite_token(const char *tok, size_t len, st_fmtflags fmt,
+		str *dst)
+{
+	long double s;
+	size_t n;
+	bool secs;
+	char *p = str_arr(dst)+dst->len;
+	if (!duration_token(tok, len, &s, &secs))
+		return false;
+	else if (secs) {
+		if (STATS_ST(STAGE_S2STR, st_s2str(s, fmt, p, ST_S2STR_MAX, &n)))
+			return false;
+		while (n && p[n-1] == ' ')
+			n--;
+		if (!n)
+			return false;
+	} else {
+		STATS_ST(STAGE_LDTOA, st_ldtoa(s, p, ST_LDTOA_MAX, &n));
+		p[n++] = 's';
+	}
+	dst->len += n;
+	return true;
+}
+
+/* A run of rewrite()'s output: n chars of input at p,
+ * or if p is NULL, the next n chars of converted tokens.
+ */
+typedef struct seg {
+	const char *p;
+	size_t n;
+} seg;
+SBOMGA_IMPL(segs, realloc, free, 0, seg) /* Dynamic array of seg */
+
+/* Appends to dst runs of [beg, end) with the duration tokens in it
+ * replaced by their conversions, which are appended to conv.
+ * Returns false only for reallocation errors.
+ */
+static bool rewrite_lines(const char *beg, const char *end, st_fmtflags fmt,
+		cache *memo, str *conv, segs *dst)
+{
+	const char *raw = beg; /* Start of input not yet in dst */
+	for (const char *p = beg; (p = scan_digit(p, end)) < end;) {
+		const char *tok = p;
+		p = token_end(tok, end);
+		if (tok > beg && isword(tok[-1]))
+			continue;
+
+		size_t oldlen = conv->len;
+		if (!str_reserve(conv, conv->len + CONVERT_MAX))
+			return false;
+		if (!convert_cached(tok, p-tok, fmt, memo, rewrite_token, conv))
+			continue;
+		if ((tok > raw && !segs_insert(dst, dst->len,
+				&(seg){raw, tok-raw}, 1))
+				|| !segs_insert(dst, dst->len,
+				&(seg){NULL, conv->len-oldlen}, 1))
+			return false;
+		raw = p;
+	}
+	return end == raw
+		|| segs_insert(dst, dst->len, &(seg){raw, end-raw}, 1);
+}
+
+/* Writes runs of src to stdout, converted tokens from conv,
+ * returning false on error.
+ */
+static bool write_segs(const segs *src, const str *conv)
+{
+	const seg *sv = segs_arr((segs *)src);
+	const char *next = str_arr((str *)conv);
+#ifdef HAVE_POSIX
+	/* Gather runs straight from where they are, without copying */
+	struct iovec iov[64];
+	for (size_t i = 0; i < src->len;) {
+		int n = 0;
+		for (; n < 64 && i < src->len; n++, i++) {
+			iov[n].iov_base = (void *)(sv[i].p ? sv[i].p : next);
+			iov[n].iov_len = sv[i].n;
+			if (!sv[i].p)
+				next += sv[i].n;
+		}
+		for (struct iovec *v = iov; n;) {
+			ssize_t w = writev(STDOUT_FILENO, v, n);
+			if (w < 0 && errno != EINTR)
+				return false;
+			for (; n && w >= (ssize_t)v->iov_len; n--, v++)
+				w -= v->iov_len;
+			if (n && w > 0)
+				v->iov_base = (char *)v->iov_base + w,
+				v->iov_len -= w;
+		}
+	}
+	return true;
 #else
-#error "Invalid value for HOW_TO_PRINT_FLOATS in config.h" 
+	for (size_t i = 0; i < src->len; i++) {
+		const char *p = sv[i].p ? sv[i].p : next;
+		if (fwrite(p, 1, sv[i].n, stdout) != sv[i].n)
+			return false;
+		if (!sv[i].p)
+			next += sv[i].n;
+	}
+	return !fflush(stdout);
 #endif
+}
 
-/* Convert s seconds to str in specified format.
+/* Copies text from stdin to stdout, replacing durations in it by their
+ * conversions with rewrite_token(), converting seconds to fmt.
+ * The last unit of fmt always keeps any fraction. Tokens are found by
+ * their leading digit, and must not be part of a larger word. Anything
+ * that isn't a duration is passed through as is.
+ * If cachecap isn't 0, conversions are cached like batch() does.
  *
- * If bit i of format is set, the tm_units[i] unit is converted to,
- * else not. 
- * Conversion begins with the largest unit,
- * converting the seconds to the greatest natural number of units,
- * then doing the same with the remaining seconds for the next largest unit,
- * and for the last unit convert remaining seconds to fractional number.
- * 
- * dst is cleared and may be realloc'd. Caller to handle deallocation.
+ * Returns EXIT_SUCCESS, or EXIT_FAILURE on errors.
+ */
+static int rewrite(st_fmtflags fmt, size_t cachecap)
+{
+	const char *err = NULL;
+	str in = str_create(BATCH_INBUF), conv = str_create(BATCH_OUTBUF);
+	segs out = segs_create(0);
+	cache *memo = cachecap ? cache_create(cachecap) : NULL;
+	if (str_cap(&in) < BATCH_INBUF || str_cap(&conv) < BATCH_OUTBUF
+			|| (cachecap && !memo)) {
+		err = "Out of memory";
+		goto end;
+	}
+
+	fmt &= (1u << ST_NUNITS) - 1;
+	for (bool eof = false; !eof;) {
+		char *end;
+		if ((err = fill(&in, stdin, &eof, &end)))
+			goto end;
+		if (!rewrite_lines(str_arr(&in), end, fmt, memo, &conv, &out)) {
+			err = "Out of memory";
+			goto end;
+		}
+		STATS_BEGIN();
+		bool wrote = write_segs(&out, &conv);
+		STATS_END(STAGE_WRITE, !wrote);
+		if (!wrote) {
+			err = "Couldn't write output";
+			goto end;
+		}
+		out.len = conv.len = 0;
+		consume(&in, end);
+	}
+end:
+	if (err)
+		fprintf(stderr, "Error: %s.\n", err);
+	if (memo)
+		report_cache(&memo, 1);
+	str_destroy(&in), str_destroy(&conv), segs_destroy(&out);
+	cache_destroy(memo);
+	return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* How where() compares durations to its threshold */
+typedef enum where_op {
+	WHERE_LT, WHERE_LE, WHERE_EQ, WHERE_NE, WHERE_GE, WHERE_GT
+} where_op;
+
+typedef struct where_cond {
+	where_op op;
+	long double secs;
+} where_cond;
+
+/* Parses a condition like ">=1h30m" from arg, an operator of <, <=, =,
+ * ==, !=, >= or >, then a threshold in seconds or time in units.
+ * Returns false if arg isn't one.
+ */
+static bool parse_where(where_cond *c, const char *arg)
+{
+	static const struct {
+		char op[3];
+		where_op val;
+	} ops[] = { /* Longest first, as "<" prefixes "<=" */
+		{"<=", WHERE_LE}, {">=", WHERE_GE}, {"==", WHERE_EQ},
+		{"!=", WHERE_NE}, {"<", WHERE_LT}, {">", WHERE_GT},
+		{"=", WHERE_EQ}
+	};
+	for (size_t i = 0; i < sizeof(ops)/sizeof(*ops); i++) {
+		size_t n = strlen(ops[i].op);
+		if (strncmp(arg, ops[i].op, n))
+			continue;
+		const char *t = arg+n;
+		size_t len = strlen(t);
+		if (!len)
+			return false;
+		c->op = ops[i].val;
+		st_err err = st_num2s(t, len, &c->secs);
+		if (err == ST_EINVAL) /* May be in time units */
+			err = st_str2s(t, len, 0, &c->secs, NULL);
+		return !err;
+	}
+	return false;
+}
+
+static bool where_holds(const where_cond *c, long double s)
+{
+	switch (c->op) {
+	case WHERE_LT: return s <  c->secs;
+	case WHERE_LE: return s <= c->secs;
+	case WHERE_EQ: return s == c->secs;
+	case WHERE_NE: return s != c->secs;
+	case WHERE_GE: return s >= c->secs;
+	case WHERE_GT: return s >  c->secs;
+	}
+	return false;
+}
+
+/* Whether line [beg, end) has a duration token, found like rewrite_lines()
+ * finds them but ending in a unit, whose seconds hold c.
+ */
+static bool where_line(const where_cond *c, const char *beg,
+		const char *end)
+{
+	for (const char *p = beg; (p = scan_digit(p, end)) < end;) {
+		const char *tok = p;
+		p = token_end(tok, end);
+		long double s;
+		bool secs;
+		if ((tok == beg || !isword(tok[-1])) && isalpha_(p[-1])
+				&& duration_token(tok, p-tok, &s, &secs)
+				&& where_holds(c, s))
+			return true;
+	}
+	return false;
+}
+
+/* Copies lines from stdin to stdout that have a duration like rewrite()
+ * converts whose seconds hold c, in full. Lines are skipped by
+ * scan_suffixed() until one has a digit followed by a unit's suffix,
+ * and only those are parsed, without formatting anything.
  *
- * Returns true on success or false for formatting or reallocation errors
- * (in which case dst is indeterminate).
+ * Returns EXIT_SUCCESS if any line matched, else EXIT_FAILURE, like grep.
  */
-static bool s2str(long double s, fmtflags format, str *dst)
-{
-	dst->len = 0;
-	bool atleastone = false;
-
-	for (uint_fast8_t i = 0; i < LEN(tm_units); i++) {
-		if (!fmtflags_get(format, i))
-			continue; /* Ignore this unit */
-
-		if (fmtflags_anysetafter(format, i)) {
-			uintmax_t x = s/tm_units[i].secs; /* truncates */
-			s = fmodl(s, tm_units[i].secs);
-
-			if (x) {
-				atleastone = true;
-
-				#define WRITE_UNIT(fmtstr) do {            \
-				/* Find space needed to print to dst */    \
-				int n = snprintf(                          \
-						NULL, 0,                   \
-						(fmtstr),                  \
-						x, tm_units[i].sfx         \
-				) + 1;                                     \
-				if (n < 0 || !str_reserve(dst,dst->len+n)) \
-					return false;                      \
-				/* Write to dst and update it's length */  \
-				dst->len += sprintf(                       \
-					str_arr(dst)+dst->len, (fmtstr),   \
-					x, tm_units[i].sfx                 \
-				);                                         \
-				} while (0)
-
-				WRITE_UNIT("%ju%c ");
+static int where(const where_cond *c)
+{
+	const char *err = NULL;
+	bool matched = false;
+	char set[ST_NUNITS+1] = {0};
+	for (size_t i = 0; i < ST_NUNITS; i++)
+		set[i] = st_units[i].sfx;
+	str in = str_create(BATCH_INBUF), out = str_create(BATCH_OUTBUF);
+	if (str_cap(&in) < BATCH_INBUF || str_cap(&out) < BATCH_OUTBUF) {
+		err = "Out of memory";
+		goto end;
+	}
+
+	for (bool eof = false; !eof;) {
+		char *end;
+		if ((err = fill(&in, stdin, &eof, &end)))
+			goto end;
+		/* Lines before beg have been looked at */
+		const char *beg = str_arr(&in);
+		for (const char *p = beg; (p = scan_suffixed(p, end, set)) < end;
+				p = beg) {
+			const char *ln = p, *nl = memchr(p, '\n', end-p);
+			while (ln > beg && ln[-1] != '\n')
+				ln--;
+			beg = nl ? nl+1 : end;
+			if (!where_line(c, ln, nl ? nl : end))
+				continue;
+			size_t len = (nl ? nl : end) - ln;
+			if (!str_reserve(&out, out.len + len + 1)) {
+				err = "Out of memory";
+				goto end;
 			}
-		} else { /* This is the last unit, convert to fractional.   */
-			long double x = s/tm_units[i].secs;
-			/* If x is 0, write iff no units previously written */
-			if (fpclassify(x) == FP_ZERO && atleastone)
-				break;
-			else
-				WRITE_UNIT(LDBL_FMTSPEC"%c");
-			#undef WRITE_UNIT	
+			memcpy(str_arr(&out)+out.len, ln, len);
+			out.len += len;
+			str_arr(&out)[out.len++] = '\n';
+			matched = true;
+			if (out.len >= BATCH_OUTBUF && !flush(&out)) {
+				err = "Couldn't write output";
+				goto end;
+			}
+		}
+		consume(&in, end);
+	}
+	if (!flush(&out) || fflush(stdout))
+		err = "Couldn't write output";
+end:
+	if (err)
+		fprintf(stderr, "Error: %s.\n", err);
+	str_destroy(&in), str_destroy(&out);
+	return matched && !err ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Most columns --csv and --tsv can select */
+#define TABLE_COLS_MAX 4096
+
+/* Layout of table()'s input, and the columns to convert */
+typedef struct layout {
+	char delim;
+	bool quoted;  /* Fields may be quoted, as in CSV */
+	size_t ncols; /* Columns upto the last selected */
+	bool sel[TABLE_COLS_MAX]; /* sel[i] if column i+1 is selected */
+} layout;
+
+/* Selects columns in t from src, like "2" or "1,3-5", counting from 1.
+ * Returns false if src is invalid.
+ */
+static bool parse_cols(layout *t, const char *src)
+{
+	for (;;) {
+		char *e;
+		if ((unsigned)*src - '0' >= 10)
+			return false;
+		unsigned long lo = strtoul(src, &e, 10), hi = lo;
+		if (*e == '-') {
+			src = e+1;
+			if ((unsigned)*src - '0' >= 10)
+				return false;
+			hi = strtoul(src, &e, 10);
 		}
+		if (!lo || hi < lo || hi > TABLE_COLS_MAX)
+			return false;
+		for (unsigned long i = lo; i <= hi; i++)
+			t->sel[i-1] = true;
+		if (hi > t->ncols)
+			t->ncols = hi;
+
+		if (!*e)
+			return true;
+		else if (*e != ',')
+			return false;
+		src = e+1;
 	}
+}
+
+/* Converts a field of len chars like convert_line(), but without the
+ * trailing space s2str() leaves after a last unit that's 0.
+ */
+static bool convert_field(const char *field, size_t len, st_fmtflags fmt,
+		str *dst)
+{
+	size_t oldlen = dst->len;
+	if (!convert_line(field, len, fmt, dst))
+		return false;
+	while (dst->len > oldlen && str_arr(dst)[dst->len-1] == ' ')
+		dst->len--;
 	return true;
 }
 
-/* If c is a suffix in tm_units, return its index, else return -1 */
-static inline int_fast8_t isfx(char c)
-{
-	for (uint_fast8_t i = 0; i < LEN(tm_units); i++)
-		if (c == tm_units[i].sfx)
-			return i;
-	return -1;
-}
-
-/* Converts src upto len chars to seconds, returning NAN on error */
-static long double str2s(const char *restrict src, size_t len)
-{
-	long double s = 0;
-	/* As unit is designated by suffix, iterate backwards */
-	while (len --> 0) {
-		int_fast8_t ci = isfx(src[len]);
-		if (ci < 0) /* prev char is non-suffix, input is invalid */
-			return NAN;
-		else {
-			const char *restrict cp = src+len;
-			/* Rewind to start of value */
-			while (len && isfx(src[len-1]) < 0)
-				len--;
-			char *ep;
-			int olderrno = errno; errno = 0;
-			/* Convert units to seconds and inc s */
-			s += strtold(src+len, &ep) * tm_units[ci].secs;
-			int newerrno = errno; errno = olderrno;
-			if (
-				ep != cp || signbit(s) 
-				|| !isfinite(s) || newerrno == ERANGE
-			)
-				return NAN;
+/* Pointer past the closing quote of the quoted run opening at q,
+ * or end if it isn't closed before end.
+ */
+static const char *quoted_end(const char *q, const char *end)
+{
+	for (q++; (q = memchr(q, '"', end-q)); q += 2)
+		if (q+1 == end || q[1] != '"') /* Not an escaped quote */
+			return q+1;
+	return end;
+}
+
+/* Pointer to the delimiter or newline ending the field at p, or end */
+static const char *field_end(const layout *t, const char *p, const char *end)
+{
+	if (t->quoted && p < end && *p == '"')
+		p = quoted_end(p, end);
+	return scan_either(p, end, t->delim, '\n');
+}
+
+/* Pointer to the newline ending the record whose fields from p on aren't
+ * selected, or end.
+ */
+static const char *record_end(const layout *t, const char *p, const char *end)
+{
+	const char *nl = t->quoted ? scan_either(p, end, '"', '\n')
+		: memchr(p, '\n', end-p);
+	if (!nl)
+		return end;
+	else if (*nl == '\n')
+		return nl;
+	/* Quotes may hide newlines, so go field by field */
+	while ((p = field_end(t, p, end)) < end && *p != '\n')
+		p++;
+	return p;
+}
+
+/* Appends to dst runs of the records in [beg, end) with their selected
+ * fields converted like rewrite_lines() does tokens. Fields are kept as
+ * they are if they can't be converted.
+ *
+ * Returns a pointer to the start of the first record not wholly in
+ * [beg, end), which is end if eof, or NULL for reallocation errors.
+ */
+static const char *table_records(const layout *t, const char *beg,
+		const char *end, bool eof, st_fmtflags fmt, cache *memo,
+		str *conv, segs *dst)
+{
+	const char *raw = beg; /* Start of input not yet in dst */
+	const char *rec = beg;
+	while (rec < end) {
+		/* Output for this record, to undo if it's incomplete */
+		size_t nsegs = dst->len, nconv = conv->len;
+		const char *oldraw = raw, *p = rec, *fe;
+		for (size_t col = 0;; col++, p = fe+1) {
+			if (col >= t->ncols) {
+				fe = record_end(t, p, end);
+				break;
+			}
+			fe = field_end(t, p, end);
+			if (!t->sel[col] || (fe == end && !eof))
+				goto next;
+
+			/* The value, without quotes or a CR before a newline */
+			const char *v = p, *ve = fe;
+			if (ve > v && ve[-1] == '\r' && (ve == end || *ve == '\n'))
+				ve--;
+			if (t->quoted && v < ve && *v == '"') {
+				if (ve-v < 2 || ve[-1] != '"'
+						|| memchr(v+1, '"', ve-1 - (v+1)))
+					goto next; /* Not a plain quoted value */
+				v++, ve--;
+			}
+			if (v == ve)
+				goto next;
+
+			size_t oldlen = conv->len;
+			if (!str_reserve(conv, conv->len + CONVERT_MAX))
+				return NULL;
+			if (!convert_cached(v, ve-v, fmt, memo, convert_field,
+					conv))
+				goto next;
+			/* Drop any quotes, keeping a CR */
+			if ((p > raw && !segs_insert(dst, dst->len,
+					&(seg){raw, p-raw}, 1))
+					|| !segs_insert(dst, dst->len,
+					&(seg){NULL, conv->len-oldlen}, 1))
+				return NULL;
+			raw = ve + (ve < fe && *ve == '"');
+		next:
+			if (fe == end || *fe == '\n')
+				break;
 		}
+		if (fe == end && !eof) {
+			dst->len = nsegs, conv->len = nconv, raw = oldraw;
+			break;
+		}
+		rec = fe < end ? fe+1 : end;
 	}
-	return s;
+	if (rec > raw && !segs_insert(dst, dst->len, &(seg){raw, rec-raw}, 1))
+		return NULL;
+	return rec;
 }
 
-/* Converts cstring to fmtflags, ignoring whitespace
- * but disallowing other non-suffix chars.
- * If src is NULL, enable all.
+/* Copies a table of delimited records from stdin to stdout, converting
+ * the fields in columns selected by t like batch() converts lines, but
+ * with the last unit of fmt keeping any fraction like rewrite() does.
+ * Everything else is copied as is.
+ * If cachecap isn't 0, conversions are cached like batch() does.
+ *
+ * Returns EXIT_SUCCESS, or EXIT_FAILURE on errors.
  */
-static bool str2fmtflags(fmtflags *dst, const char *restrict src)
+static int table(const layout *t, st_fmtflags fmt, size_t cachecap)
 {
-	if (!src) {
-		*dst = fmtflags_all1;
-		return true;
+	const char *err = NULL;
+	str in = str_create(BATCH_INBUF), conv = str_create(BATCH_OUTBUF);
+	segs out = segs_create(0);
+	cache *memo = cachecap ? cache_create(cachecap) : NULL;
+	if (str_cap(&in) < BATCH_INBUF || str_cap(&conv) < BATCH_OUTBUF
+			|| (cachecap && !memo)) {
+		err = "Out of memory";
+		goto end;
 	}
-	
-	*dst = fmtflags_all0;
-	for (char c; (c = *src); src++) {
-		if (isspace(c))
-			continue;
-		
-		int_fast8_t i = isfx(c);
-		if (i < 0)
-			return false;
-		else
-			fmtflags_set(dst, i);
+
+	fmt &= (1u << ST_NUNITS) - 1;
+	for (bool eof = false; !eof;) {
+		char *end;
+		const char *rest;
+		if ((err = fill(&in, stdin, &eof, &end)))
+			goto end;
+		if (!(rest = table_records(t, str_arr(&in), end, eof, fmt, memo,
+				&conv, &out))) {
+			err = "Out of memory";
+			goto end;
+		}
+		STATS_BEGIN();
+		bool wrote = write_segs(&out, &conv);
+		STATS_END(STAGE_WRITE, !wrote);
+		if (!wrote) {
+			err = "Couldn't write output";
+			goto end;
+		}
+		out.len = conv.len = 0;
+		consume(&in, rest);
+	}
+end:
+	if (err)
+		fprintf(stderr, "Error: %s.\n", err);
+	if (memo)
+		report_cache(&memo, 1);
+	str_destroy(&in), str_destroy(&conv), segs_destroy(&out);
+	cache_destroy(memo);
+	return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#ifdef HAVE_POSIX
+/* Bytes of input converted at a time by each of parallel()'s workers */
+#define PARALLEL_CHUNK (1 << 20)
+/* Most worker threads parallel() will start */
+#define PARALLEL_MAXJOBS 1024
+
+/* A chunk of lines being converted, or converted and waiting to be written */
+typedef struct chunk {
+	str out;
+	bool done, oom, allgood;
+} chunk;
+
+/* State shared by parallel() and its workers.
+ *
+ * Chunk k of the input is converted into slots[k % nslots] by any worker.
+ * A worker may claim chunk k only once chunk k-nslots has been written,
+ * which bounds memory use regardless of input size.
+ * Each worker takes its own cache from memos, if not NULL.
+ */
+typedef struct parallel_job {
+	const char *arr;
+	size_t len;
+	st_fmtflags fmt;
+	cache **memos;
+	size_t nmemos; /* Taken by workers */
+
+	chunk *slots;
+	size_t nchunks, nslots;
+
+	pthread_mutex_t mtx;
+	pthread_cond_t claimable, done;
+	size_t next, written; /* Chunks claimed by workers, written out */
+	bool stop;
+} parallel_job;
+
+/* Offset in arr of the first line to start at or after off */
+static size_t line_start(const char *arr, size_t len, size_t off)
+{
+	if (!off || off >= len)
+		return off ? len : 0;
+	const char *nl = memchr(arr+off-1, '\n', len-(off-1));
+	return nl ? (size_t)(nl+1 - arr) : len;
+}
+
+static void *parallel_worker(void *arg)
+{
+	parallel_job *job = arg;
+
+	pthread_mutex_lock(&job->mtx);
+	cache *memo = job->memos ? job->memos[job->nmemos++] : NULL;
+	pthread_mutex_unlock(&job->mtx);
+
+	for (;;) {
+		pthread_mutex_lock(&job->mtx);
+		while (!job->stop && job->next < job->nchunks
+				&& job->next >= job->written + job->nslots)
+			pthread_cond_wait(&job->claimable, &job->mtx);
+		if (job->stop || job->next >= job->nchunks) {
+			pthread_mutex_unlock(&job->mtx);
+			break;
+		}
+		size_t k = job->next++;
+		pthread_mutex_unlock(&job->mtx);
+
+		size_t beg = line_start(job->arr, job->len, k*PARALLEL_CHUNK);
+		size_t end = line_start(job->arr, job->len, (k+1)*PARALLEL_CHUNK);
+		chunk *c = &job->slots[k % job->nslots];
+		c->out.len = 0;
+		c->allgood = true;
+		c->oom = !convert_lines(job->arr+beg, job->arr+end, job->fmt,
+				memo, &c->out, &c->allgood);
+
+		pthread_mutex_lock(&job->mtx);
+		c->done = true;
+		pthread_cond_signal(&job->done);
+		pthread_mutex_unlock(&job->mtx);
+	}
+	stats_merge();
+	return NULL;
+}
+
+/* Converts lines of the file at path to stdout like batch() does,
+ * with njobs threads converting chunks of it in parallel.
+ * The file is mmap'd and consumed in order, so it may be larger than RAM.
+ * If cachecap isn't 0, each thread has its own cache of cachecap entries.
+ *
+ * Returns EXIT_SUCCESS if every line was converted, else EXIT_FAILURE.
+ */
+static int parallel(const char *path, size_t njobs, st_fmtflags fmt,
+		size_t cachecap)
+{
+	const char *err = NULL;
+	bool allgood = true;
+
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st)) {
+		if (fd >= 0)
+			close(fd);
+		fprintf(stderr, "Error: Couldn't open %s.\n", path);
+		return EXIT_FAILURE;
+	}
+	parallel_job job = {
+		.len = st.st_size, .fmt = fmt,
+		.nchunks = (st.st_size + PARALLEL_CHUNK-1) / PARALLEL_CHUNK,
+		.nslots = 2*njobs,
+		.mtx = PTHREAD_MUTEX_INITIALIZER,
+		.claimable = PTHREAD_COND_INITIALIZER,
+		.done = PTHREAD_COND_INITIALIZER
+	};
+	if (!job.len) {
+		close(fd);
+		return EXIT_SUCCESS;
+	}
+	void *map = mmap(NULL, job.len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Error: Couldn't map %s.\n", path);
+		return EXIT_FAILURE;
+	}
+	job.arr = map;
+	madvise(map, job.len, MADV_SEQUENTIAL);
+
+	pthread_t *workers = calloc(njobs, sizeof(*workers));
+	job.slots = calloc(job.nslots, sizeof(*job.slots));
+	size_t nworkers = 0, nmemos = 0;
+	if (!workers || !job.slots) {
+		err = "Out of memory";
+		goto end;
+	}
+	if (cachecap) {
+		if (!(job.memos = calloc(njobs, sizeof(*job.memos)))) {
+			err = "Out of memory";
+			goto end;
+		}
+		while (nmemos < njobs
+				&& (job.memos[nmemos] = cache_create(cachecap)))
+			nmemos++;
+		if (nmemos < njobs) {
+			err = "Out of memory";
+			goto end;
+		}
+	}
+	while (nworkers < njobs && !pthread_create(
+			&workers[nworkers], NULL, parallel_worker, &job))
+		nworkers++;
+	if (!nworkers) {
+		err = "Couldn't start threads";
+		goto end;
+	}
+
+	/* Write out chunks in input order as workers finish them */
+	const long pagesz = sysconf(_SC_PAGESIZE);
+	for (size_t k = 0; k < job.nchunks && !err; k++) {
+		chunk *c = &job.slots[k % job.nslots];
+
+		pthread_mutex_lock(&job.mtx);
+		while (!c->done)
+			pthread_cond_wait(&job.done, &job.mtx);
+		pthread_mutex_unlock(&job.mtx);
+
+		allgood &= c->allgood;
+		if (c->oom)
+			err = "Out of memory";
+		else if (!flush(&c->out))
+			err = "Couldn't write output";
+
+		/* Drop pages of input that have been consumed */
+		size_t end = line_start(job.arr, job.len, (k+1)*PARALLEL_CHUNK);
+		size_t beg = line_start(job.arr, job.len, k*PARALLEL_CHUNK);
+		beg -= beg % pagesz, end -= end % pagesz;
+		if (end > beg)
+			madvise((char *)map + beg, end-beg, MADV_DONTNEED);
+
+		pthread_mutex_lock(&job.mtx);
+		c->done = false;
+		job.written++;
+		pthread_cond_broadcast(&job.claimable);
+		pthread_mutex_unlock(&job.mtx);
+	}
+	if (!err && fflush(stdout))
+		err = "Couldn't write output";
+end:
+	pthread_mutex_lock(&job.mtx);
+	job.stop = true;
+	pthread_cond_broadcast(&job.claimable);
+	pthread_mutex_unlock(&job.mtx);
+	while (nworkers)
+		pthread_join(workers[--nworkers], NULL);
+
+	if (job.memos) {
+		if (job.nmemos)
+			report_cache(job.memos, job.nmemos);
+		while (nmemos)
+			cache_destroy(job.memos[--nmemos]);
+		free(job.memos);
 	}
+
+	if (job.slots)
+		for (size_t i = 0; i < job.nslots; i++)
+			str_destroy(&job.slots[i].out);
+	free(job.slots), free(workers);
+	munmap(map, job.len);
+
+	if (err)
+		fprintf(stderr, "Error: %s.\n", err);
+	return allgood && !err ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
+
+/* For modes taking [format] then files: sets *fmt from arg and returns
+ * true if it's a format, else leaves *fmt as ST_FMT_ALL and returns false.
+ */
+static bool opt_format(const char *arg, st_fmtflags *fmt)
+{
+	st_fmtflags f;
+	*fmt = ST_FMT_ALL;
+	if (!arg || st_str2fmtflags(&f, arg))
+		return false;
+	*fmt = f;
 	return true;
 }
 
@@ -221,41 +1037,181 @@ int main(int argc, char **argv)
 {
 	int ret = EXIT_FAILURE;
 
-	if (argc >= 2) {
+	/* Options, which precede the mode and its arguments */
+	unsigned long cachecap = 0;
+	bool stats = false;
+	for (;;) {
 		char *e;
-		/* Assume argument is numerical */
-		long double s = strtold(argv[1], &e);
-		if (*e) { /* Not numerical, may be in time units */ 
-			if (argc > 2)
-				goto badargs;
-
-			s = str2s(argv[1], strlen(argv[1]));
-			if (isnan(s))
-				fprintf(stderr, "Error: Invalid argument.\n");
-			else {
-				printf(LDBL_FMTSPEC"s\n", s);
-				ret = EXIT_SUCCESS;
-			}
-		} else if (signbit(s) || !isfinite(s) || errno == ERANGE)
-			fprintf(stderr, "Error: Argument out of range.\n");
-		else { /* Is numerical, convert seconds to time units */
-			fmtflags fmt;
-			if (!str2fmtflags(&fmt, argv[2]))
+		int n = 2; /* Args of the option */
+		if (argc >= 3 && !strcmp(argv[1], "--cache")) {
+			cachecap = strtoul(argv[2], &e, 10);
+			if (*e || !cachecap || cachecap > CACHE_CAP_MAX)
 				goto badargs;
+		} else if (argc >= 2 && !strcmp(argv[1], "--stats")) {
+#ifndef ST_STATS
+			fprintf(stderr, "Error: --stats needs secondtime built "
+				"with -DST_STATS.\n");
+			return EXIT_FAILURE;
+#endif
+			stats = true, n = 1;
+		} else
+			break;
+		/* Drop the option, keeping argv[0] for the usage message */
+		argv[n] = argv[0], argv += n, argc -= n;
+	}
+	if (stats)
+		stats_start();
 
-			str buf = {0};
-			if (!s2str(s, fmt, &buf))
-				fprintf(stderr, "Error: Couldn't convert.\n");
-			else {
-				printf("%s\n", str_arr(&buf));
-				ret = EXIT_SUCCESS;
-			}
-			str_destroy(&buf);
+	if (argc >= 2 && (!strcmp(argv[1], "-") || !strcmp(argv[1], "--batch"))) {
+		st_fmtflags fmt;
+		if (argc > 3 || st_str2fmtflags(&fmt, argv[2]))
+			goto badargs;
+		ret = batch(fmt, cachecap);
+	} else if (argc >= 2 && !strcmp(argv[1], "--rewrite")) {
+		st_fmtflags fmt;
+		if (argc > 3 || st_str2fmtflags(&fmt, argv[2]))
+			goto badargs;
+		ret = rewrite(fmt, cachecap);
+	} else if (argc == 3 && !strcmp(argv[1], "--where") && !cachecap) {
+		where_cond c;
+		if (!parse_where(&c, argv[2]))
+			goto badargs;
+		ret = where(&c);
+	} else if (argc >= 3 && argc <= 4 && (!strcmp(argv[1], "--csv")
+			|| !strcmp(argv[1], "--tsv"))) {
+		st_fmtflags fmt;
+		bool csv = !strcmp(argv[1], "--csv");
+		layout t = {.delim = csv ? ',' : '\t', .quoted = csv};
+		if (!parse_cols(&t, argv[2]) || st_str2fmtflags(&fmt, argv[3]))
+			goto badargs;
+		ret = table(&t, fmt, cachecap);
+	} else if (argc >= 2 && !strcmp(argv[1], "--aggregate") && !cachecap) {
+		st_fmtflags fmt;
+		int first = opt_format(argv[2], &fmt) ? 3 : 2;
+		if (!(fmt & ((1u << ST_NUNITS) - 1)))
+			goto badargs;
+		ret = aggregate(fmt, argv+first, argc-first);
+	} else if (argc >= 4 && argc <= 5 && !strcmp(argv[1], "--anchor")
+			&& !cachecap) {
+		st_fmtflags fmt;
+		if (st_str2fmtflags(&fmt, argv[4]))
+			goto badargs;
+		ret = anchored(argv[2], strcmp(argv[3], "-") ? argv[3] : NULL,
+			fmt);
+	} else if (argc >= 4 && argc <= 5 && !strcmp(argv[1], "--sort")
+			&& !cachecap) {
+		char *e;
+		st_fmtflags fmt;
+		unsigned long mib = strtoul(argv[2], &e, 10);
+		if (*e || !mib || mib > SIZE_MAX >> 20
+				|| st_str2fmtflags(&fmt, argv[4]))
+			goto badargs;
+		ret = sort_lines(argv[3], (size_t)mib << 20, fmt, argc == 5);
+	} else if (argc >= 3 && !strcmp(argv[1], "--files")) {
+		st_fmtflags fmt;
+		int first = opt_format(argv[2], &fmt) ? 3 : 2;
+		if (first == argc)
+			goto badargs;
+#ifdef HAVE_POSIX
+		ret = files(fmt, argv+first, argc-first, cachecap);
+#else
+		fprintf(stderr, "Error: --files is unsupported on this system.\n");
+#endif
+	} else if (argc >= 4 && !strcmp(argv[1], "--binary") && !cachecap) {
+		st_fmtflags fmt;
+		bool f64 = !strcmp(argv[2], "f64"), packed;
+		if (argc > 5 || (!f64 && strcmp(argv[2], "ns"))
+				|| (!(packed = !strcmp(argv[3], "packed"))
+					&& strcmp(argv[3], "text"))
+				|| st_str2fmtflags(&fmt, argv[4])
+				|| !(fmt & ((1u << ST_NUNITS) - 1)))
+			goto badargs;
+		ret = binary(f64 ? BIN_F64 : BIN_NS, packed, fmt);
+	} else if (argc >= 2 && !strcmp(argv[1], "-j")) {
+		char *e;
+		st_fmtflags fmt;
+		unsigned long njobs = argc >= 3 ? strtoul(argv[2], &e, 10) : 0;
+		if (argc < 4 || argc > 5 || *e || !njobs
+				|| njobs > PARALLEL_MAXJOBS
+				|| st_str2fmtflags(&fmt, argv[4]))
+			goto badargs;
+		else if (!strcmp(argv[3], "-"))
+			ret = batch(fmt, cachecap);
+		else
+#ifdef HAVE_POSIX
+			ret = parallel(argv[3], njobs, fmt, cachecap);
+#else
+			fprintf(stderr, "Error: -j is unsupported on this system.\n");
+#endif
+	} else if (argc == 3 && !strcmp(argv[1], "--serve") && !cachecap) {
+#ifdef __linux__
+		ret = serve(argv[2]);
+#else
+		fprintf(stderr, "Error: --serve is unsupported on this system.\n");
+#endif
+	} else if (argc >= 3 && argc <= 4 && !strcmp(argv[1], "--shm")
+			&& !cachecap) {
+		char *e;
+		unsigned long nlanes = argc == 4 ? strtoul(argv[3], &e, 10) : 1;
+		if ((argc == 4 && *e) || !nlanes || nlanes > SHM_MAXLANES)
+			goto badargs;
+#ifdef __linux__
+		ret = shm_serve(argv[2], nlanes);
+#else
+		fprintf(stderr, "Error: --shm is unsupported on this system.\n");
+#endif
+	} else if (argc >= 2 && argc <= 3 && !strcmp(argv[1], "--coproc")
+			&& !cachecap) {
+		st_fmtflags fmt;
+		if (st_str2fmtflags(&fmt, argv[2]))
+			goto badargs;
+#ifdef HAVE_POSIX
+		ret = coproc(fmt);
+#else
+		fprintf(stderr, "Error: --coproc is unsupported on this system.\n");
+#endif
+	} else if (argc >= 4 && argc <= 5 && !strcmp(argv[1], "--client")
+			&& !cachecap) {
+#ifdef HAVE_POSIX
+		ret = client(argv[2], argv[3], argv[4]);
+#else
+		fprintf(stderr, "Error: --client is unsupported on this system.\n");
+#endif
+	} else if (argc >= 2 && !cachecap) {
+		/* An empty time is 0 seconds, as it always was here */
+		const char *time = *argv[1] ? argv[1] : "0";
+		char buf[ARGS_MAX];
+		switch (convert_args(time, strlen(time), argv[2],
+				ST_FMT_ALL, buf)) {
+		case ARGS_OK:
+			printf("%s\n", buf);
+			ret = EXIT_SUCCESS;
+			break;
+		case ARGS_ERR:
+			fprintf(stderr, "Error: %s.\n", buf);
+			break;
+		case ARGS_BAD:
+			goto badargs;
 		}
 	} else badargs:
 		fprintf(stderr,
 		"Error : Incorrect argument(s).\n"
 		"Usage : %s <time> [format]\n"
+		"        %s - [format]\n"
+		"        %s -j <jobs> <file> [format]\n"
+		"        %s --files [format] <files>\n"
+		"        %s --cache <entries> - [format]\n"
+		"        %s --anchor <date> <time|-> [format]\n"
+		"        %s --aggregate [format] [files]\n"
+		"        %s --sort <MiB> <file|-> [format]\n"
+		"        %s --rewrite [format]\n"
+		"        %s --csv <columns> [format]\n"
+		"        %s --where <op><time>\n"
+		"        %s --binary <f64|ns> <text|packed> [format]\n"
+		"        %s --serve <socket>\n"
+		"        %s --client <socket> <time> [format]\n"
+		"        %s --shm <name> [lanes]\n"
+		"        %s --coproc [format]\n"
 		"\n"
 		"Help  : This program lets you use seconds as your unit of time.\n"
 		"        It has two basic functions:\n"
@@ -289,6 +1245,19 @@ int main(int argc, char **argv)
 		"\n"
 		"              (2 weeks, 3.36111 days)\n"
 		"\n"
+		"        (1.2) To count calendar years and months from a date:\n"
+		"\n"
+		"              \t%s --anchor <date> <time|-> [format]\n"
+		"\n"
+		"              <date> is YYYY-MM-DD. Months run to the same\n"
+		"              day of the next, or its last if it's shorter.\n"
+		"              Example: 45 days from 2024-01-31.\n"
+		"\n"
+		"                       $ %s --anchor 2024-01-31 45d Md\n"
+		"                       1M 16d\n"
+		"\n"
+		"              With -, converts lines of stdin like (3).\n"
+		"\n"
 		"        (2) To convert time to seconds, use it like so:\n"
 		"\n"
 		"            \t%s <time units with suffix>\n"
@@ -300,7 +1269,164 @@ int main(int argc, char **argv)
 		"                     1.5e+06s\n"
 		"\n"
 		"            (1.5 x 10^6 seconds)\n"
-		, argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+		"\n"
+		"        (3) To convert many values at once, use it like so:\n"
+		"\n"
+		"            \t%s - [format]\n"
+		"\n"
+		"            Reads one value per line from stdin and writes one\n"
+		"            result per line to stdout, like (1) or (2) as fits.\n"
+		"            Seconds are all converted to the same [format].\n"
+		"            Lines that can't be converted give \""BAD_LINE"\".\n"
+		"            --batch can be used in place of -.\n"
+		"\n"
+		"        (3.1) To convert a large file faster, use it like so:\n"
+		"\n"
+		"              \t%s -j <jobs> <file> [format]\n"
+		"\n"
+		"              Like (3), but reads from file, converting with\n"
+		"              upto <jobs> threads in parallel.\n"
+		"\n"
+		"              \t%s --files [format] <files>\n"
+		"\n"
+		"              Like (3), but converts each of <files> to a\n"
+		"              file of the same name with .out appended,\n"
+		"              reading and writing while it converts, with\n"
+		"              io_uring on Linux. Writes the throughput of\n"
+		"              each file, and of all, to stderr.\n"
+		"\n"
+		"        (3.2) To convert input that repeats a lot faster, use:\n"
+		"\n"
+		"              \t%s --cache <entries> - [format]\n"
+		"\n"
+		"              Like (3), but remembers upto <entries> results\n"
+		"              of values upto 36 chars long, forgetting the\n"
+		"              least recently used, to skip converting them\n"
+		"              again. Each entry takes 128 bytes. --cache may\n"
+		"              also precede -j, giving each thread a cache.\n"
+		"              Cache hits and misses are written to stderr.\n"
+		"\n"
+		"        (3.3) To sum up many values instead, use it like so:\n"
+		"\n"
+		"              \t%s --aggregate [format] [files]\n"
+		"\n"
+		"              Reads values like (3) from stdin, or from each\n"
+		"              of [files] in parallel, and writes their count,\n"
+		"              sum, mean, min, max and percentiles 50, 90, 99\n"
+		"              and 99.9 in [format]. Sums are exact, and the\n"
+		"              percentiles within 0.5%% of the nearest-rank\n"
+		"              values.\n"
+		"              Empty lines are skipped.\n"
+		"\n"
+		"        (3.4) To sort values by duration, use it like so:\n"
+		"\n"
+		"              \t%s --sort <MiB> <file|-> [format]\n"
+		"\n"
+		"              Writes lines of <file>, or stdin with -, in\n"
+		"              order of their seconds, equal ones in their\n"
+		"              order of input, as they were or converted to\n"
+		"              [format] if given. Input over about <MiB> is\n"
+		"              sorted in parts, spilled to temporary files\n"
+		"              and merged. Lines that can't be converted go\n"
+		"              last.\n"
+		"\n"
+		"        (4) To convert times within text, like logs, use:\n"
+		"\n"
+		"            \t%s --rewrite [format]\n"
+		"\n"
+		"            Copies stdin to stdout, converting seconds with\n"
+		"            an s suffix to [format] and time in units to\n"
+		"            seconds, leaving the rest of the text as is.\n"
+		"            Example: $ echo 'took 5400s, max 2h' | %s --rewrite\n"
+		"                     took 1h 30m, max 7200s\n"
+		"\n"
+		"            Units must be largest first, without spaces.\n"
+		"            --cache may precede --rewrite as with (3).\n"
+		"\n"
+		"        (4.1) To convert columns of a table, use it like so:\n"
+		"\n"
+		"              \t%s --csv <columns> [format]\n"
+		"              \t%s --tsv <columns> [format]\n"
+		"\n"
+		"              Copies CSV or tab separated records from stdin\n"
+		"              to stdout, converting fields of <columns>\n"
+		"              like (3), but keeping fields that can't be\n"
+		"              converted, and the rest of each record, as is.\n"
+		"              Columns count from 1, like 2 or 1,3-5.\n"
+		"              Example: $ echo 'job,5400' | %s --csv 2\n"
+		"                       job,1h 30m\n"
+		"\n"
+		"              --cache may precede them as with (3).\n"
+		"\n"
+		"        (4.2) To find lines with long or short durations, use:\n"
+		"\n"
+		"              \t%s --where <op><time>\n"
+		"\n"
+		"              Copies lines from stdin to stdout that have a\n"
+		"              duration like (4) that is <op> <time>, where\n"
+		"              <op> is one of <, <=, =, !=, >= or >. Only\n"
+		"              durations ending in a unit, like 5400s or\n"
+		"              1h30m, count.\n"
+		"              Example: $ echo 'took 2h5m' | %s --where '>90m'\n"
+		"                       took 2h5m\n"
+		"\n"
+		"        (5) To convert binary values, use it like so:\n"
+		"\n"
+		"            \t%s --binary <f64|ns> <text|packed> [format]\n"
+		"\n"
+		"            Reads little-endian float64 seconds or int64\n"
+		"            nanoseconds from stdin, writing lines like (3)\n"
+		"            or packed records of per-unit counts, as laid\n"
+		"            out in README.md, to stdout.\n"
+		"\n"
+		"        (6) To convert without starting a process each time:\n"
+		"\n"
+		"            \t%s --serve <socket>\n"
+		"\n"
+		"            Serves conversions over a Unix domain socket\n"
+		"            until interrupted. Clients send lines of\n"
+		"            <time> [format], as many as they like without\n"
+		"            waiting, and get a line for each in order:\n"
+		"            \"OK <result>\" or \"ERR <error>\".\n"
+		"\n"
+		"            \t%s --client <socket> <time> [format]\n"
+		"\n"
+		"            Converts like (1) or (2), but with the server.\n"
+		"            A line of \":format [format]\" sets the format\n"
+		"            of later lines without one on that connection.\n"
+		"\n"
+		"            \t%s --shm <name> [lanes]\n"
+		"\n"
+		"            Serves conversions to upto [lanes] programs\n"
+		"            on this host at a time, 1 by default, through\n"
+		"            rings in shared memory named <name>, as laid\n"
+		"            out in ring.h.\n"
+		"\n"
+		"        (7) To convert for another program, over a pipe:\n"
+		"\n"
+		"            \t%s --coproc [format]\n"
+		"\n"
+		"            Answers lines from stdin like --serve does,\n"
+		"            writing each answer out as soon as it's ready,\n"
+		"            with [format] for lines without one.\n"
+		"\n"
+		"        (8) To see where a run spends its time, use:\n"
+		"\n"
+		"            \t%s --stats <any of the above>\n"
+		"\n"
+		"            Writes the calls, errors and time taken by each\n"
+		"            stage, like parsing, formatting and I/O, to\n"
+		"            stderr at exit. Needs secondtime to be built\n"
+		"            with -DST_STATS.\n"
+		, argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+		argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+		argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+		argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+		argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+		argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+		argv[0]);
 
+	if (stats)
+		stats_report();
 	return ret;
 }
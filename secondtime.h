@@ -0,0 +1,190 @@
+#ifndef SECONDTIME_H
+#define SECONDTIME_H
+
+#include <stdbool.h> /* bool                         */
+#include <stddef.h>  /* size_t                       */
+#include <stdint.h>  /* uint_least8_t, int_least32_t, uintmax_t */
+#include <limits.h>  /* CHAR_BIT                     */
+#include <float.h>   /* DECIMAL_DIG                  */
+
+/* libsecondtime: convert seconds to time units and vice versa.
+ *
+ * Every function writes only to caller-provided memory,
+ * never allocates and never modifies errno.
+ * They are all thread-safe.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A unit of time, as a number of seconds and a suffix to denote it */
+typedef struct st_unit {
+	long double secs;
+	char sfx;
+} st_unit;
+
+/* Units of time, from largest to smallest:
+ * years (y), months (M), weeks (w), days (d),
+ * hours (h), minutes (m) and seconds (s).
+ * Length of a year is configured in config.h, a month is 1/12th of it.
+ */
+enum { ST_NUNITS = 7 };
+extern const st_unit st_units[ST_NUNITS];
+
+/* st_s2str() format flags: Bit i corresponds to st_units[i]. */
+typedef uint_least8_t st_fmtflags;
+#define ST_FMT_NONE ((st_fmtflags)0)
+#define ST_FMT_ALL  ((st_fmtflags)~ST_FMT_NONE)
+
+typedef enum st_err {
+	ST_OK,      /* Success                                 */
+	ST_EINVAL,  /* Input is not valid                      */
+	ST_ERANGE,  /* Input is negative, non-finite or too big */
+	ST_ENOBUFS  /* Output doesn't fit in destination       */
+} st_err;
+
+/* Numbers longer than this many chars are treated as invalid input */
+#define ST_NUM_MAX 128
+
+/* Max chars written by st_ldtoa() and st_s2str(), including the NUL.
+ * These hold for either style of printing floats in config.h.
+ */
+#define ST_UINTMAX_DIG (sizeof(uintmax_t)*CHAR_BIT*31/100 + 1)
+#define ST_LDTOA_MAX   (1 /* - */ + DECIMAL_DIG + 1 /* . */ + 4 /* 0.000 */ \
+			+ 2 /* e+ */ + 6 /* exponent */ + 1 /* NUL */)
+#define ST_S2STR_MAX   (ST_NUNITS*(ST_UINTMAX_DIG + 2) + ST_LDTOA_MAX + 1)
+
+/* Converts src upto len chars, a real number of seconds like "1.5e6",
+ * to *dst.
+ *
+ * Returns ST_OK, ST_EINVAL if src isn't entirely a number, or is empty,
+ * or ST_ERANGE if it is negative, non-finite or out of range.
+ */
+st_err st_num2s(const char *src, size_t len, long double *dst);
+
+/* st_str2s() flags */
+enum {
+	ST_STRICT = 1 /* Reject units that repeat or aren't largest first */
+};
+
+/* Converts src upto len chars, time in units like "2w3d8h40m",
+ * to *dst seconds. Units may repeat and be in any order, unless flags
+ * has ST_STRICT. If every term is whole nanoseconds, like "1.5h" or
+ * "0.25s", and they total below 2^64 nanoseconds, *dst is their exact
+ * sum correctly rounded.
+ *
+ * Returns ST_OK, ST_EINVAL if src isn't valid time in units, or is
+ * empty, or ST_ERANGE if it or any coefficient is negative,
+ * non-finite or out of range. On error, if errpos is not NULL,
+ * sets *errpos to the offset in src of the first invalid char,
+ * which is len if src ends without a suffix.
+ */
+st_err st_str2s(const char *src, size_t len, unsigned flags,
+		long double *dst, size_t *errpos);
+
+/* Converts cstring src, a set of unit suffixes like "wd", to *dst,
+ * ignoring whitespace. If src is NULL, all units are enabled.
+ *
+ * Returns ST_OK or ST_EINVAL if src has a char that isn't a suffix.
+ */
+st_err st_str2fmtflags(st_fmtflags *dst, const char *src);
+
+/* Writes x as a NUL-terminated decimal to dst of cap chars,
+ * in the style of printing floats configured in config.h.
+ * cap >= ST_LDTOA_MAX always suffices.
+ *
+ * Returns ST_OK or ST_ENOBUFS, and if len is not NULL,
+ * sets *len to the number of chars written excluding the NUL.
+ */
+st_err st_ldtoa(long double x, char *dst, size_t cap, size_t *len);
+
+/* Converts s seconds to time in units as selected by fmt,
+ * writing it as a NUL-terminated string to dst of cap chars.
+ * cap >= ST_S2STR_MAX always suffices.
+ *
+ * Conversion begins with the largest unit,
+ * converting the seconds to the greatest natural number of units,
+ * then doing the same with the remaining seconds for the next largest unit,
+ * and for the last unit converts remaining seconds to a fractional number.
+ * If s is whole nanoseconds to within its precision, as decimals of upto
+ * 9 places are, it's converted exactly, with the fraction correctly
+ * rounded. That holds below 2^64 seconds where the compiler has 128-bit
+ * integers, else below 2^64 nanoseconds, about 584 years.
+ *
+ * Returns ST_OK, ST_ERANGE if s is negative or non-finite, or ST_ENOBUFS,
+ * and if len is not NULL, sets *len to the number of chars written
+ * excluding the NUL.
+ */
+st_err st_s2str(long double s, st_fmtflags fmt,
+		char *dst, size_t cap, size_t *len);
+
+/* A date in the proleptic Gregorian calendar */
+typedef struct st_date {
+	int_least32_t year;
+	uint_least8_t month, day; /* From 1 */
+} st_date;
+
+/* Converts cstring src, a date like "2024-01-31", to *dst.
+ *
+ * Returns ST_OK or ST_EINVAL if src isn't a valid date as YYYY-MM-DD.
+ */
+st_err st_str2date(st_date *dst, const char *src);
+
+/* Converts s seconds like st_s2str() does, but as a duration starting at
+ * 00:00 of date from, in calendar years and months: as many as fit from
+ * there, from the same day of the month, or the last day of shorter
+ * months. So 2024-01-31 plus one month is 2024-02-29. The seconds left
+ * over are converted to the other units as st_s2str() would. If years or
+ * months is the last unit, its fraction is of the one in progress.
+ * Days are 86400 seconds, and config.h's year is unused. Without years
+ * and months in fmt, it's st_s2str().
+ *
+ * Returns ST_OK, ST_ERANGE if s is negative, non-finite or 2^62 or more,
+ * ST_EINVAL if from isn't a valid date, or ST_ENOBUFS, and if len is not
+ * NULL, sets *len to the number of chars written excluding the NUL.
+ */
+st_err st_s2str_anchored(long double s, st_date from, st_fmtflags fmt,
+		char *dst, size_t cap, size_t *len);
+
+/* Per-unit parts of many values of seconds, from st_decompose().
+ *
+ * For value k, counts[i][k] is its whole number of st_units[i],
+ * for every unit selected but the last. rem[k] is the remaining seconds
+ * as a fractional number of the last unit selected.
+ * counts[i] may be NULL for units that aren't written.
+ */
+typedef struct st_parts {
+	uint_least64_t *counts[ST_NUNITS];
+	double *rem;
+} st_parts;
+
+/* Implementations of st_decompose() */
+typedef enum st_kernel {
+	ST_KERNEL_AUTO,   /* Fastest supported by the CPU */
+	ST_KERNEL_SCALAR,
+	ST_KERNEL_SSE2,   /* Need x86 with SSE2 */
+	ST_KERNEL_AVX2    /* Need x86 with AVX2 and FMA */
+} st_kernel;
+
+/* Decomposes n values of seconds in secs into parts of units selected
+ * by fmt, as st_s2str() does one value at a time, but in double
+ * precision and with SIMD where possible. Bits of fmt beyond
+ * ST_NUNITS are ignored, so the last selected unit gets the remainder.
+ *
+ * Counts are exact and the remainder is the exact fmod() of the
+ * previous unit regardless of kernel, so all kernels give identical
+ * results. Forcing an unsupported kernel is undefined behaviour.
+ *
+ * Returns ST_OK, or ST_ERANGE if any value is negative, non-finite or
+ * has a count beyond 2^64-1, in which case its counts are 0 or
+ * saturated, and its rem NaN if it isn't a non-negative finite number.
+ */
+st_err st_decompose(const double *secs, size_t n, st_fmtflags fmt,
+		const st_parts *dst, st_kernel kernel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
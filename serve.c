@@ -0,0 +1,559 @@
+#define _DEFAULT_SOURCE /* MSG_NOSIGNAL, SOCK_CLOEXEC */
+
+#include <stdio.h>  /* fprintf, printf, stderr */
+#include <stdlib.h> /* EXIT_SUCCESS, EXIT_FAILURE, realloc, free */
+#include <string.h> /* memchr, memmove, strlen, strchr, strcmp, strncmp */
+#include <stdint.h> /* uint64_t */
+
+#include "cli.h"
+
+#ifdef HAVE_POSIX
+#include <errno.h>      /* errno, EINTR, EAGAIN, EWOULDBLOCK, ECONNREFUSED */
+#include <fcntl.h>      /* fcntl, O_NONBLOCK */
+#include <signal.h>     /* sigset_t, sigprocmask, SIGINT, SIGTERM */
+#include <time.h>       /* clock_gettime, CLOCK_MONOTONIC */
+#include <unistd.h>     /* read, write, close, unlink */
+#include <sys/socket.h> /* socket, bind, listen, accept, connect, send */
+#include <sys/stat.h>   /* lstat, S_ISSOCK */
+#include <sys/un.h>     /* struct sockaddr_un */
+#ifdef __linux__
+#include <sys/epoll.h>    /* epoll_* */
+#include <sys/signalfd.h> /* signalfd */
+#endif
+
+/* Sets sa to the address of the socket at path, false if it's too long */
+static bool sockaddr_of(const char *path, struct sockaddr_un *sa)
+{
+	*sa = (struct sockaddr_un){.sun_family = AF_UNIX};
+	if (strlen(path) >= sizeof(sa->sun_path))
+		return false;
+	strcpy(sa->sun_path, path);
+	return true;
+}
+
+/* Sends all n chars of buf to fd, returning false on error */
+static bool send_all(int fd, const char *buf, size_t n)
+{
+	while (n) {
+		ssize_t w = send(fd, buf, n, MSG_NOSIGNAL);
+		if (w < 0 && errno != EINTR)
+			return false;
+		else if (w > 0)
+			buf += w, n -= w;
+	}
+	return true;
+}
+
+int client(const char *path, const char *time, const char *fmt)
+{
+	struct sockaddr_un sa;
+	if (strchr(time, '\n') || (fmt && strchr(fmt, '\n'))) {
+		fprintf(stderr, "Error: Invalid argument.\n");
+		return EXIT_FAILURE;
+	} else if (!sockaddr_of(path, &sa)) {
+		fprintf(stderr, "Error: Socket path is too long.\n");
+		return EXIT_FAILURE;
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+		fprintf(stderr, "Error: Couldn't connect to %s.\n", path);
+		if (fd >= 0)
+			close(fd);
+		return EXIT_FAILURE;
+	}
+
+	/* One request, and read upto the end of its response */
+	int ret = EXIT_FAILURE;
+	str buf = str_create(ARGS_MAX + sizeof("ERR \n"));
+	char *nl = NULL;
+	if (!str_insert(&buf, 0, time, strlen(time))
+			|| (fmt && (!str_insert(&buf, buf.len, " ", 1)
+			|| !str_insert(&buf, buf.len, fmt, strlen(fmt))))
+			|| !str_insert(&buf, buf.len, "\n", 1)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		goto end;
+	} else if (!send_all(fd, str_arr(&buf), buf.len)) {
+		fprintf(stderr, "Error: Couldn't send request.\n");
+		goto end;
+	}
+	buf.len = 0;
+	while (!nl) {
+		if (!str_reserve(&buf, buf.len + 256)) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			goto end;
+		}
+		ssize_t n = read(fd, str_arr(&buf)+buf.len, 256);
+		if (n < 0 && errno == EINTR)
+			continue;
+		else if (n <= 0) {
+			fprintf(stderr, "Error: No response from %s.\n", path);
+			goto end;
+		}
+		nl = memchr(str_arr(&buf)+buf.len, '\n', n);
+		buf.len += n;
+	}
+
+	*nl = '\0';
+	const char *res = str_arr(&buf);
+	if (!strncmp(res, "OK ", 3)) {
+		printf("%s\n", res+3);
+		ret = EXIT_SUCCESS;
+	} else
+		fprintf(stderr, "Error: %s.\n",
+			strncmp(res, "ERR ", 4) ? "Bad response" : res+4);
+end:
+	close(fd);
+	str_destroy(&buf);
+	return ret;
+}
+
+/* Appends the response to request [beg, end), which it modifies, to out.
+ * *fmt is the format of requests without one, set by ":format".
+ */
+static bool respond(char *beg, char *end, st_fmtflags *fmt, str *out)
+{
+	if (end > beg && end[-1] == '\r')
+		end--;
+	*end = '\0';
+
+	/* Split into upto 2 arguments, in place */
+	char *args[3] = {0};
+	size_t nargs = 0;
+	for (char *p = beg; p < end && nargs < 3;) {
+		while (p < end && (*p == ' ' || *p == '\t'))
+			*p++ = '\0';
+		if (p < end)
+			args[nargs++] = p;
+		while (p < end && *p != ' ' && *p != '\t')
+			p++;
+	}
+
+	char buf[ARGS_MAX];
+	args_res r;
+	if (nargs < 1 || nargs > 2)
+		r = ARGS_BAD;
+	else if (!strcmp(args[0], ":format")) {
+		/* Answer with the units now selected */
+		st_fmtflags f;
+		r = STATS_ST(STAGE_FMTFLAGS, st_str2fmtflags(&f, args[1]))
+			? ARGS_BAD : ARGS_OK;
+		if (r == ARGS_OK) {
+			size_t n = 0;
+			for (uint_fast8_t i = 0; i < ST_NUNITS; i++)
+				if (f >> i & 1)
+					buf[n++] = st_units[i].sfx;
+			buf[n] = '\0';
+			*fmt = f;
+		}
+	} else
+		r = convert_args(args[0], strlen(args[0]), args[1], *fmt, buf);
+	const char *res = r == ARGS_BAD ? "Incorrect argument(s)" : buf;
+	const char *tag = r == ARGS_OK ? "OK " : "ERR ";
+	return str_insert(out, out->len, tag, strlen(tag))
+		&& str_insert(out, out->len, res, strlen(res))
+		&& str_insert(out, out->len, "\n", 1);
+}
+
+/* Longest request: --serve disconnects a client that sends a longer one,
+ * --coproc answers it with an error and skips to the next.
+ */
+#define SERVE_LINE_MAX 4096
+
+/* Writes all n chars of buf to fd, returning false on error */
+static bool write_all(int fd, const char *buf, size_t n)
+{
+	while (n) {
+		ssize_t w = write(fd, buf, n);
+		if (w < 0 && errno != EINTR)
+			return false;
+		else if (w > 0)
+			buf += w, n -= w;
+	}
+	return true;
+}
+
+int coproc(st_fmtflags fmt)
+{
+	const char *err = NULL;
+	str in = str_create(BATCH_INBUF), out = str_create(BATCH_INBUF);
+	bool skip = false; /* Rest of a request that was too long */
+	for (bool eof = false; !eof;) {
+		if (!str_reserve(&in, in.len + BATCH_INBUF)) {
+			err = "Out of memory";
+			break;
+		}
+		/* Take what the caller has written so far, without waiting
+		 * for a full buffer like stdio would.
+		 */
+		STATS_BEGIN();
+		ssize_t n = read(STDIN_FILENO, str_arr(&in)+in.len, BATCH_INBUF);
+		STATS_END(STAGE_READ, n < 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		else if (n < 0) {
+			err = "Couldn't read input";
+			break;
+		}
+		eof = !n;
+		in.len += n;
+
+		/* Answer every complete request, and a last unterminated one */
+		char *arr = str_arr(&in), *beg = arr, *end = arr + in.len, *nl;
+		if (skip && (nl = memchr(beg, '\n', end-beg)))
+			beg = nl+1, skip = false;
+		else if (skip)
+			beg = end;
+		while ((nl = memchr(beg, '\n', end-beg))
+				|| (eof && beg < end && (nl = end))) {
+			if (!respond(beg, nl, &fmt, &out)) {
+				err = "Out of memory";
+				break;
+			}
+			beg = nl < end ? nl+1 : end;
+		}
+		/* Don't keep reading a request without end */
+		if (!err && end-beg > SERVE_LINE_MAX) {
+			static const char tl[] = "ERR Request is too long\n";
+			if (!str_insert(&out, out.len, tl, sizeof(tl)-1))
+				err = "Out of memory";
+			beg = end, skip = true;
+		}
+		in.len = end - beg;
+		memmove(arr, beg, in.len);
+
+		STATS_BEGIN();
+		bool wrote = write_all(STDOUT_FILENO, str_arr(&out), out.len);
+		STATS_END(STAGE_WRITE, !wrote);
+		if (!wrote) {
+			err = "Couldn't write output";
+			break;
+		}
+		out.len = 0;
+		if (err)
+			break;
+	}
+	if (err)
+		fprintf(stderr, "Error: %s.\n", err);
+	str_destroy(&in), str_destroy(&out);
+	return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#ifdef __linux__
+/* Bytes read from a client at a time */
+#define SERVE_READ 65536
+/* Stop reading requests from a client with this many bytes of responses
+ * it hasn't read yet, until it catches up.
+ */
+#define SERVE_OUT_MAX (1 << 20)
+/* Buffers bigger than this aren't kept for reuse */
+#define SERVE_KEEP (1 << 16)
+
+/* Log-linear histogram of latencies in ns, with 8 buckets per power of 2,
+ * so percentiles are within 12.5%.
+ */
+#define HIST_SUB 8
+typedef struct hist {
+	unsigned long long n, counts[64*HIST_SUB];
+} hist;
+
+static void hist_add(hist *h, uint64_t ns, unsigned long long n)
+{
+	size_t b = ns;
+	if (ns >= HIST_SUB) {
+		unsigned e = 63 - __builtin_clzll(ns);
+		b = (e-2)*HIST_SUB + (ns >> (e-3) & (HIST_SUB-1));
+	}
+	h->counts[b] += n, h->n += n;
+}
+
+/* Midpoint of the bucket holding the pth fraction of latencies, in ns */
+static double hist_at(const hist *h, double p)
+{
+	unsigned long long want = p*h->n + 0.5, seen = 0;
+	for (size_t b = 0; b < 64*HIST_SUB; b++)
+		if ((seen += h->counts[b]) >= want && h->counts[b]) {
+			if (b < HIST_SUB)
+				return b;
+			double step = 1ull << (b/HIST_SUB - 1);
+			return (HIST_SUB + b%HIST_SUB + 0.5) * step;
+		}
+	return 0;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+/* A client and its buffers, kept for the next client when it leaves */
+typedef struct conn {
+	int fd;
+	uint32_t events; /* Registered with epoll */
+	bool eof;
+	str in, out;
+	size_t sent;     /* Chars of out written */
+	size_t pending;  /* Requests with responses in out */
+	st_fmtflags fmt; /* Of requests without one */
+	uint64_t t;      /* When the first of them was read */
+	struct conn *next;
+} conn;
+
+SBOMGA_IMPL(conns, realloc, free, 0, conn *) /* Clients by fd */
+
+typedef struct server {
+	int ep;
+	conns byfd;
+	conn *spare; /* Free list */
+	hist lat;
+	unsigned long long nconns;
+} server;
+
+/* Responds to complete requests in c->in, and a last unterminated one
+ * once c has shut down writing, while c isn't too far behind.
+ */
+static bool respond_all(conn *c)
+{
+	/* respond() terminates the last one in place */
+	if (c->eof && !str_reserve(&c->in, c->in.len + 1))
+		return false;
+	char *arr = str_arr(&c->in), *beg = arr, *end = arr + c->in.len, *nl;
+	while (c->out.len - c->sent < SERVE_OUT_MAX
+			&& ((nl = memchr(beg, '\n', end-beg))
+			|| (c->eof && beg < end && (nl = end)))) {
+		if (!respond(beg, nl, &c->fmt, &c->out))
+			return false;
+		c->pending++;
+		beg = nl < end ? nl+1 : end;
+	}
+	c->in.len = end - beg;
+	memmove(arr, beg, c->in.len);
+	return c->in.len <= SERVE_LINE_MAX || memchr(arr, '\n', c->in.len);
+}
+
+/* Writes as much of c->out as the socket takes, timing requests once
+ * their responses are all written.
+ */
+static bool drain(server *sv, conn *c)
+{
+	while (c->sent < c->out.len) {
+		STATS_BEGIN();
+		ssize_t w = send(c->fd, str_arr(&c->out) + c->sent,
+				c->out.len - c->sent, MSG_NOSIGNAL);
+		STATS_END(STAGE_WRITE, w < 0);
+		if (w > 0)
+			c->sent += w;
+		else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return true;
+		else if (errno != EINTR)
+			return false;
+	}
+	if (c->pending)
+		hist_add(&sv->lat, now_ns() - c->t, c->pending);
+	c->out.len = c->sent = c->pending = 0;
+	return true;
+}
+
+/* Handles events on c, returning false if it should be closed */
+static bool handle(server *sv, conn *c, uint32_t events)
+{
+	if (events & (EPOLLIN | EPOLLHUP | EPOLLERR) && !c->eof) {
+		if (!str_reserve(&c->in, c->in.len + SERVE_READ))
+			return false;
+		STATS_BEGIN();
+		ssize_t n = read(c->fd, str_arr(&c->in) + c->in.len, SERVE_READ);
+		STATS_END(STAGE_READ, n < 0);
+		if (n > 0) {
+			if (!c->pending)
+				c->t = now_ns();
+			c->in.len += n;
+		} else if (!n)
+			c->eof = true;
+		else if (errno != EAGAIN && errno != EWOULDBLOCK
+				&& errno != EINTR)
+			return false;
+	}
+
+	/* Keep going while the client keeps up with what it sent */
+	do {
+		if (!respond_all(c) || !drain(sv, c))
+			return false;
+	} while (!c->out.len && memchr(str_arr(&c->in), '\n', c->in.len));
+	if (c->eof && !c->out.len)
+		return false;
+
+	uint32_t want = c->out.len ? EPOLLOUT : 0;
+	if (!c->eof && c->out.len - c->sent < SERVE_OUT_MAX)
+		want |= EPOLLIN;
+	if (want != c->events) {
+		struct epoll_event ev = {.events = want, .data.ptr = c};
+		if (epoll_ctl(sv->ep, EPOLL_CTL_MOD, c->fd, &ev))
+			return false;
+		c->events = want;
+	}
+	return true;
+}
+
+static void hangup(server *sv, conn *c)
+{
+	close(c->fd);
+	conns_arr(&sv->byfd)[c->fd] = NULL;
+	if (str_cap(&c->in) > SERVE_KEEP)
+		str_destroy(&c->in), c->in = str_create(0);
+	if (str_cap(&c->out) > SERVE_KEEP)
+		str_destroy(&c->out), c->out = str_create(0);
+	c->next = sv->spare, sv->spare = c;
+}
+
+/* Sets c as the client on fd */
+static bool track(server *sv, int fd, conn *c)
+{
+	size_t len = sv->byfd.len;
+	if ((size_t)fd >= len) {
+		if (!conns_insert(&sv->byfd, len, NULL, fd+1 - len))
+			return false;
+		while (len < (size_t)fd)
+			conns_arr(&sv->byfd)[len++] = NULL;
+	}
+	conns_arr(&sv->byfd)[fd] = c;
+	return true;
+}
+
+/* Accepts every waiting client */
+static void accept_all(server *sv, int lfd)
+{
+	for (int fd; (fd = accept(lfd, NULL, NULL)) >= 0;) {
+		conn *c = sv->spare;
+		if (c)
+			sv->spare = c->next;
+		else if ((c = malloc(sizeof(*c))))
+			c->in = str_create(0), c->out = str_create(0);
+
+		struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+		if (!c || fcntl(fd, F_SETFL, O_NONBLOCK) || !track(sv, fd, c)
+				|| epoll_ctl(sv->ep, EPOLL_CTL_ADD, fd, &ev)) {
+			close(fd);
+			if (c)
+				track(sv, fd, NULL),
+				c->next = sv->spare, sv->spare = c;
+			continue;
+		}
+		c->fd = fd, c->events = EPOLLIN, c->eof = false;
+		c->fmt = ST_FMT_ALL;
+		c->in.len = c->out.len = c->sent = c->pending = 0;
+		sv->nconns++;
+	}
+}
+
+/* Clears the way to bind to sa: replaces a socket left by a server that
+ * died, but not one a server answers on, nor anything else. Returns false
+ * if path is taken.
+ */
+static bool sock_take(const char *path, const struct sockaddr_un *sa)
+{
+	struct stat st;
+	if (lstat(path, &st) || !S_ISSOCK(st.st_mode))
+		return true; /* bind() fails on anything else */
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return true;
+	bool live = !connect(fd, (const struct sockaddr *)sa, sizeof(*sa))
+		|| errno != ECONNREFUSED;
+	close(fd);
+	if (live) {
+		fprintf(stderr, "Error: %s is already being served.\n", path);
+		return false;
+	}
+	unlink(path);
+	return true;
+}
+
+/* Unlinks path if it's still the socket bound as ours */
+static void sock_release(const char *path, const struct stat *ours)
+{
+	struct stat now;
+	if (!lstat(path, &now) && now.st_dev == ours->st_dev
+			&& now.st_ino == ours->st_ino)
+		unlink(path);
+}
+
+int serve(const char *path)
+{
+	struct sockaddr_un sa;
+	if (!sockaddr_of(path, &sa)) {
+		fprintf(stderr, "Error: Socket path is too long.\n");
+		return EXIT_FAILURE;
+	} else if (!sock_take(path, &sa))
+		return EXIT_FAILURE;
+
+	/* Handle signals as events, to stop between requests */
+	sigset_t sigs;
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT), sigaddset(&sigs, SIGTERM);
+	sigprocmask(SIG_BLOCK, &sigs, NULL);
+
+	server sv = {.ep = -1, .byfd = conns_create(0)};
+	int ret = EXIT_FAILURE;
+	int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	int sfd = signalfd(-1, &sigs, SFD_CLOEXEC);
+	struct stat ours;
+	if (lfd < 0 || bind(lfd, (struct sockaddr *)&sa, sizeof(sa))) {
+		fprintf(stderr, "Error: Couldn't bind to %s.\n", path);
+		goto end;
+	} else if (lstat(path, &ours)) {
+		fprintf(stderr, "Error: Couldn't bind to %s.\n", path);
+		unlink(path);
+		goto end;
+	}
+	struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &lfd};
+	if (sfd < 0 || listen(lfd, SOMAXCONN)
+			|| fcntl(lfd, F_SETFL, O_NONBLOCK)
+			|| (sv.ep = epoll_create1(EPOLL_CLOEXEC)) < 0
+			|| epoll_ctl(sv.ep, EPOLL_CTL_ADD, lfd, &ev)
+			|| (ev.data.ptr = &sfd,
+				epoll_ctl(sv.ep, EPOLL_CTL_ADD, sfd, &ev))) {
+		fprintf(stderr, "Error: Couldn't listen on %s.\n", path);
+		goto unbind;
+	}
+
+	for (bool stop = false; !stop;) {
+		struct epoll_event evs[64];
+		int n = epoll_wait(sv.ep, evs, 64, -1);
+		for (int i = 0; i < n; i++)
+			if (evs[i].data.ptr == &lfd)
+				accept_all(&sv, lfd);
+			else if (evs[i].data.ptr == &sfd)
+				stop = true;
+			else if (!handle(&sv, evs[i].data.ptr, evs[i].events))
+				hangup(&sv, evs[i].data.ptr);
+		if (n < 0 && errno != EINTR) {
+			fprintf(stderr, "Error: Couldn't wait for clients.\n");
+			goto unbind;
+		}
+	}
+	fprintf(stderr, "Served %llu requests to %llu clients, "
+		"latency p50 %.1fus p99 %.1fus.\n", sv.lat.n, sv.nconns,
+		hist_at(&sv.lat, 0.5) / 1e3, hist_at(&sv.lat, 0.99) / 1e3);
+	ret = EXIT_SUCCESS;
+unbind:
+	sock_release(path, &ours);
+end:
+	for (size_t i = 0; i < sv.byfd.len; i++)
+		if (conns_arr(&sv.byfd)[i])
+			hangup(&sv, conns_arr(&sv.byfd)[i]);
+	for (conn *c; (c = sv.spare);) {
+		sv.spare = c->next;
+		str_destroy(&c->in), str_destroy(&c->out), free(c);
+	}
+	conns_destroy(&sv.byfd);
+	if (sv.ep >= 0)
+		close(sv.ep);
+	if (sfd >= 0)
+		close(sfd);
+	if (lfd >= 0)
+		close(lfd);
+	return ret;
+}
+#endif
+#endif
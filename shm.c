@@ -0,0 +1,184 @@
+#define _DEFAULT_SOURCE /* syscall, for ring.h, and flock */
+
+#include <stdio.h>  /* fprintf, stderr */
+#include <stdlib.h> /* EXIT_SUCCESS, EXIT_FAILURE, calloc, free */
+
+#include "cli.h"
+
+#ifdef __linux__
+#include <pthread.h>  /* pthread_* */
+#include <signal.h>   /* sigset_t, sigwait, SIGINT, SIGTERM */
+#include <sys/file.h> /* flock */
+
+#include "ring.h" /* ring_*, shm_open, mmap */
+
+_Static_assert(RING_TEXT >= ST_S2STR_MAX, "RING_TEXT is too short");
+
+/* A lane's worker and what it answered */
+typedef struct shm_worker {
+	ring_region *r;
+	ring_lane *lane;
+	unsigned long long n;
+	pthread_t thread;
+} shm_worker;
+
+/* Answers request rq in response rs, without s2str()'s trailing space
+ * after a last unit that's 0.
+ */
+static void answer(const ring_slot *rq, ring_slot *rs)
+{
+	size_t n = 0;
+	long double s = 0;
+	st_err err;
+	if (rq->op == RING_S2STR) {
+		s = rq->secs;
+		err = STATS_ST(STAGE_S2STR, st_s2str(s, rq->flags, rs->text,
+			RING_TEXT, &n));
+		while (n && rs->text[n-1] == ' ')
+			n--;
+	} else if (rq->op == RING_STR2S && rq->len <= RING_TEXT)
+		err = STATS_ST(STAGE_STR2S, st_str2s(rq->text, rq->len,
+			rq->flags, &s, NULL));
+	else
+		err = ST_EINVAL;
+	rs->id = rq->id, rs->flags = rq->flags;
+	rs->op = err, rs->len = err ? 0 : n;
+	rs->secs = err ? 0 : s;
+}
+
+/* Opens the region at name to serve it, locked for as long as it's open
+ * so other servers and producers can tell it's live. Replaces a region
+ * left by a server that died, which no one has locked. Returns its fd,
+ * empty, or -1 after writing why to stderr.
+ */
+static int shm_take(const char *name)
+{
+	for (;;) {
+		struct stat st;
+		int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+		if (fd < 0) {
+			fprintf(stderr, "Error: Couldn't create %s.\n", name);
+			return -1;
+		} else if (flock(fd, LOCK_EX | LOCK_NB)) {
+			fprintf(stderr, "Error: %s is already being served.\n",
+				name);
+			close(fd);
+			return -1;
+		} else if (fstat(fd, &st)) {
+			fprintf(stderr, "Error: Couldn't create %s.\n", name);
+			close(fd);
+			return -1;
+		} else if (!st.st_size) /* Just created */
+			return fd;
+
+		/* Only a region of a server that died is ours to replace */
+		uint32_t magic = 0;
+		if ((size_t)st.st_size < sizeof(ring_region)
+				|| pread(fd, &magic, sizeof(magic), 0)
+					!= sizeof(magic)
+				|| magic != RING_MAGIC) {
+			fprintf(stderr, "Error: %s isn't a region of "
+				"secondtime.\n", name);
+			close(fd);
+			return -1;
+		}
+		shm_unlink(name);
+		close(fd);
+	}
+}
+
+/* Unlinks name if it's still the region of fd, and closes fd */
+static void shm_release(const char *name, int fd)
+{
+	struct stat ours, now;
+	int cur = shm_open(name, O_RDONLY, 0);
+	if (cur >= 0 && !fstat(fd, &ours) && !fstat(cur, &now)
+			&& ours.st_dev == now.st_dev && ours.st_ino == now.st_ino)
+		shm_unlink(name);
+	if (cur >= 0)
+		close(cur);
+	close(fd);
+}
+
+/* Answers requests of its lane in order until the region stops */
+static void *shm_work(void *arg)
+{
+	shm_worker *w = arg;
+	const uint32_t *stop = &w->r->stop;
+	ring_slot *rq, *rs;
+	while ((rq = ring_peek_wait(&w->lane->req, stop))
+			&& (rs = ring_claim_wait(&w->lane->res, stop))) {
+		answer(rq, rs);
+		ring_pop(&w->lane->req);
+		ring_push(&w->lane->res);
+		w->n++;
+	}
+	stats_merge();
+	return NULL;
+}
+
+int shm_serve(const char *name, size_t nlanes)
+{
+	/* Let only this thread take signals, to stop the workers */
+	sigset_t sigs;
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT), sigaddset(&sigs, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+	const size_t size = ring_region_size(nlanes);
+	ring_region *r = MAP_FAILED;
+	int fd = shm_take(name);
+	if (fd >= 0 && !ftruncate(fd, size))
+		r = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (r == MAP_FAILED) {
+		if (fd >= 0) {
+			fprintf(stderr, "Error: Couldn't create %s.\n", name);
+			shm_release(name, fd);
+		}
+		return EXIT_FAILURE;
+	}
+	/* ftruncate() zeroed it, so rings start empty */
+	r->version = RING_VERSION, r->nlanes = nlanes;
+	__atomic_store_n(&r->magic, RING_MAGIC, __ATOMIC_RELEASE);
+
+	int ret = EXIT_FAILURE;
+	size_t nworkers = 0;
+	shm_worker *workers = calloc(nlanes, sizeof(*workers));
+	while (workers && nworkers < nlanes) {
+		shm_worker *w = &workers[nworkers];
+		w->r = r, w->lane = &r->lanes[nworkers];
+		if (pthread_create(&w->thread, NULL, shm_work, w))
+			break;
+		nworkers++;
+	}
+	if (nworkers < nlanes)
+		fprintf(stderr, "Error: Couldn't start workers.\n");
+	else {
+		int sig;
+		sigwait(&sigs, &sig);
+		ret = EXIT_SUCCESS;
+	}
+
+	/* Wake workers asleep on their lanes, any that were just falling
+	 * asleep see stop within RING_NAP.
+	 */
+	__atomic_store_n(&r->stop, 1, __ATOMIC_RELEASE);
+	unsigned long long n = 0;
+	for (size_t i = 0; i < nworkers; i++) {
+		ring_lane *l = workers[i].lane;
+		ring_wake(&l->req.tail, &l->req.popwait);
+		ring_wake(&l->res.head, &l->res.pushwait);
+	}
+	for (size_t i = 0; i < nworkers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		n += workers[i].n;
+	}
+	if (ret == EXIT_SUCCESS)
+		fprintf(stderr, "Served %llu requests on %zu lanes.\n", n,
+			nlanes);
+	free(workers);
+	munmap(r, size);
+	shm_release(name, fd);
+	return ret;
+}
+#endif
@@ -0,0 +1,409 @@
+#define _DEFAULT_SOURCE /* fileno */
+
+#include <stdio.h>  /* FILE, fopen, fread, fwrite, tmpfile, stdin, stderr */
+#include <stdlib.h> /* EXIT_SUCCESS, EXIT_FAILURE, realloc, free */
+#include <string.h> /* memchr, memcpy, strcmp */
+#include <stdint.h> /* uint16_t, uint32_t, uint64_t */
+#include <math.h>   /* frexpl, ldexpl */
+
+#include "cli.h"
+
+#ifdef HAVE_POSIX
+#include <sys/stat.h> /* fstat, S_ISREG */
+#include <sys/mman.h> /* mmap, munmap */
+#endif
+
+/* Sorted runs spilled at once before they're merged into one */
+#define SORT_FANIN 64
+
+/* A line and its key, which compares as its seconds do: the exponent of
+ * the seconds, biased to be unsigned, above the line's offset in hi, and
+ * the mantissa in lo. Lines without seconds get SORT_EXP_BAD, after all
+ * others, and 0 gets exponent 0, before all others.
+ */
+typedef struct sort_rec {
+	uint64_t lo, hi;
+} sort_rec;
+#define SORT_OFF_BITS 48
+#define SORT_OFF_MASK ((UINT64_C(1) << SORT_OFF_BITS) - 1)
+#define SORT_EXP_BIAS 0x8000
+#define SORT_EXP_BAD  0xFFFF
+
+/* Memory each line takes besides its chars: its record, and the copy of
+ * it the radix sort needs.
+ */
+#define SORT_REC_COST (2*sizeof(sort_rec))
+
+/* Bytes of a record spilled to a run: the key's exponent and mantissa,
+ * then the line's length, then the line.
+ */
+#define RUN_HEADER 14
+
+/* Sets r to the line at off of len chars and its key */
+static void rec_of(sort_rec *r, const char *line, size_t len, uint64_t off,
+		bool *allgood)
+{
+	if (len && line[len-1] == '\r')
+		len--;
+	long double s;
+	st_err err = STATS_ST(STAGE_NUM2S, st_num2s(line, len, &s));
+	if (err == ST_EINVAL) /* May be in time units */
+		err = STATS_ST(STAGE_STR2S, st_str2s(line, len, 0, &s, NULL));
+	uint64_t exp = 0, mant = 0;
+	if (err)
+		exp = SORT_EXP_BAD, *allgood = false;
+	else if (s) {
+		int e;
+		mant = ldexpl(frexpl(s, &e), 64);
+		exp = e + SORT_EXP_BIAS;
+	}
+	r->lo = mant;
+	r->hi = exp << SORT_OFF_BITS | off;
+}
+
+/* Seconds of a key, which mustn't be SORT_EXP_BAD */
+static long double key_secs(uint64_t exp, uint64_t mant)
+{
+	return exp ? ldexpl(mant, (int)exp - SORT_EXP_BIAS - 64) : 0;
+}
+
+/* Sorts n records of a by key with an LSD radix sort of a byte per pass,
+ * with tmp of n records, skipping passes of bytes all keys share. Stable,
+ * so lines of equal keys stay in order. Returns a or tmp, whichever ends
+ * up sorted.
+ */
+static sort_rec *radix_sort(sort_rec *a, sort_rec *tmp, size_t n)
+{
+	/* Bytes of lo, then the exponent's 2 of hi */
+	enum { PASSES = 10 };
+	size_t counts[PASSES][256] = {0};
+	for (size_t k = 0; k < n; k++) {
+		for (unsigned b = 0; b < 8; b++)
+			counts[b][a[k].lo >> 8*b & 0xFF]++;
+		counts[8][a[k].hi >> SORT_OFF_BITS & 0xFF]++;
+		counts[9][a[k].hi >> (SORT_OFF_BITS+8) & 0xFF]++;
+	}
+
+	for (unsigned pass = 0; pass < PASSES && n; pass++) {
+		const bool hi = pass >= 8;
+		const unsigned shift = hi ? SORT_OFF_BITS + 8*(pass-8) : 8*pass;
+		size_t *c = counts[pass];
+		if (c[(hi ? a[0].hi : a[0].lo) >> shift & 0xFF] == n)
+			continue;
+		size_t sum = 0;
+		for (unsigned i = 0; i < 256; i++) {
+			size_t t = c[i];
+			c[i] = sum, sum += t;
+		}
+		for (size_t k = 0; k < n; k++)
+			tmp[c[(hi ? a[k].hi : a[k].lo) >> shift & 0xFF]++] = a[k];
+		sort_rec *t = a;
+		a = tmp, tmp = t;
+	}
+	return a;
+}
+
+/* State of sort_lines() */
+typedef struct sorter {
+	size_t budget;
+	st_fmtflags fmt;
+	bool reformat; /* Else writes lines as they were */
+	sort_rec *recs, *tmp;
+	size_t nrecs, caprecs;
+	FILE *runs[SORT_FANIN];
+	size_t nruns;
+	str out;
+	bool allgood;
+} sorter;
+
+/* Appends a line of key exp and mant to output, returning false on error */
+static bool emit(sorter *st, uint64_t exp, uint64_t mant, const char *line,
+		size_t len)
+{
+	str *out = &st->out;
+	if (!str_reserve(out, out->len + len + ST_S2STR_MAX + 1))
+		return false;
+	char *p = str_arr(out)+out->len;
+	if (!st->reformat)
+		memcpy(p, line, len);
+	else if (exp == SORT_EXP_BAD
+			|| STATS_ST(STAGE_S2STR, st_s2str(key_secs(exp, mant),
+				st->fmt, p, ST_S2STR_MAX, &len)))
+		memcpy(p, BAD_LINE, len = sizeof(BAD_LINE)-1);
+	p[len++] = '\n';
+	out->len += len;
+	return out->len < BATCH_OUTBUF || flush(out);
+}
+
+/* Writes a record of key exp and mant and its line to run f */
+static bool spill(FILE *f, uint64_t exp, uint64_t mant, const char *line,
+		uint32_t len)
+{
+	unsigned char h[RUN_HEADER];
+	uint16_t e = exp;
+	memcpy(h, &e, 2), memcpy(h+2, &mant, 8), memcpy(h+10, &len, 4);
+	return fwrite(h, 1, sizeof(h), f) == sizeof(h)
+		&& fwrite(line, 1, len, f) == len;
+}
+
+/* A run being merged, and its next record */
+typedef struct run_reader {
+	FILE *f;
+	uint64_t exp, mant;
+	str line;
+	bool done;
+} run_reader;
+
+/* Reads the next record of r, returning false on error */
+static bool run_next(run_reader *r)
+{
+	unsigned char h[RUN_HEADER];
+	size_t n = fread(h, 1, sizeof(h), r->f);
+	if (!n)
+		return r->done = true, !ferror(r->f);
+	uint16_t e;
+	uint32_t len;
+	memcpy(&e, h, 2), memcpy(&r->mant, h+2, 8), memcpy(&len, h+10, 4);
+	r->exp = e;
+	r->line.len = 0;
+	return n == sizeof(h) && str_reserve(&r->line, len)
+		&& fread(str_arr(&r->line), 1, len, r->f) == len
+		&& (r->line.len = len, true);
+}
+
+/* Whether run a's record goes before b's: by key, then by run, so that
+ * merging is stable as runs are in input order.
+ */
+static bool run_before(const run_reader *rs, size_t a, size_t b)
+{
+	const run_reader *x = &rs[a], *y = &rs[b];
+	if (x->exp != y->exp)
+		return x->exp < y->exp;
+	if (x->mant != y->mant)
+		return x->mant < y->mant;
+	return a < b;
+}
+
+static void sift_down(const run_reader *rs, size_t *heap, size_t n, size_t i)
+{
+	for (size_t c; (c = 2*i+1) < n; i = c) {
+		if (c+1 < n && run_before(rs, heap[c+1], heap[c]))
+			c++;
+		if (!run_before(rs, heap[c], heap[i]))
+			break;
+		size_t t = heap[i];
+		heap[i] = heap[c], heap[c] = t;
+	}
+}
+
+/* Merges st's runs in order into run dst, or output if dst is NULL,
+ * closing them. Returns NULL or an error message.
+ */
+static const char *merge(sorter *st, FILE *dst)
+{
+	const char *err = NULL;
+	size_t n = st->nruns, heap[SORT_FANIN], live = 0;
+	run_reader rs[SORT_FANIN];
+	for (size_t i = 0; i < n; i++) {
+		rs[i] = (run_reader){.f = st->runs[i], .line = str_create(0)};
+		rewind(rs[i].f);
+		setvbuf(rs[i].f, NULL, _IOFBF, BATCH_INBUF);
+		if (!run_next(&rs[i]))
+			err = "Couldn't read a sorted run";
+		else if (!rs[i].done)
+			heap[live++] = i;
+	}
+	for (size_t i = live/2; i --> 0;)
+		sift_down(rs, heap, live, i);
+
+	while (live && !err) {
+		run_reader *r = &rs[heap[0]];
+		if (dst ? !spill(dst, r->exp, r->mant, str_arr(&r->line),
+					r->line.len)
+				: !emit(st, r->exp, r->mant, str_arr(&r->line),
+					r->line.len))
+			err = dst ? "Couldn't write a sorted run"
+				: "Couldn't write output";
+		else if (!run_next(r))
+			err = "Couldn't read a sorted run";
+		else if (r->done)
+			heap[0] = heap[--live];
+		sift_down(rs, heap, live, 0);
+	}
+	for (size_t i = 0; i < n; i++)
+		fclose(rs[i].f), str_destroy(&rs[i].line);
+	st->nruns = 0;
+	return err;
+}
+
+/* Sorts st's records of lines at base, which end by end, and writes them
+ * out if last and no run was spilled, else spills them as a run, merging
+ * runs into one if there are SORT_FANIN. Returns NULL or an error message.
+ */
+static const char *sort_records(sorter *st, const char *base,
+		const char *end, bool last)
+{
+	const char *err = NULL;
+	sort_rec *r = radix_sort(st->recs, st->tmp, st->nrecs);
+	FILE *run = NULL;
+	if (!last || st->nruns) {
+		if (!(run = tmpfile()))
+			return "Couldn't create a temporary file";
+		setvbuf(run, NULL, _IOFBF, BATCH_OUTBUF);
+	}
+	for (size_t k = 0; k < st->nrecs && !err; k++) {
+		const char *line = base + (r[k].hi & SORT_OFF_MASK);
+		const char *nl = memchr(line, '\n', end-line);
+		size_t len = (nl ? nl : end) - line;
+		uint64_t exp = r[k].hi >> SORT_OFF_BITS;
+		if (run ? !spill(run, exp, r[k].lo, line, len)
+				: !emit(st, exp, r[k].lo, line, len))
+			err = run ? "Couldn't write a sorted run"
+				: "Couldn't write output";
+	}
+	st->nrecs = 0;
+	if (!run)
+		return err;
+	else if (err || fflush(run)) {
+		fclose(run);
+		return err ? err : "Couldn't write a sorted run";
+	}
+
+	st->runs[st->nruns++] = run;
+	if (st->nruns == SORT_FANIN && !last) {
+		if (!(run = tmpfile()))
+			return "Couldn't create a temporary file";
+		setvbuf(run, NULL, _IOFBF, BATCH_OUTBUF);
+		if ((err = merge(st, run)) || fflush(run)) {
+			fclose(run);
+			return err ? err : "Couldn't write a sorted run";
+		}
+		st->runs[st->nruns++] = run;
+	}
+	return last ? merge(st, NULL) : NULL;
+}
+
+/* Adds records of lines from *pos upto end of base to st, while they and
+ * their chars stay within st's budget, but at least one.
+ * Advances *pos past them. Returns false if out of memory.
+ */
+static bool add_lines(sorter *st, const char *base, size_t *pos,
+		const char *end)
+{
+	const char *p = base + *pos;
+	while (p < end && (!st->nrecs || (size_t)(p - base)
+			+ (st->nrecs+1)*SORT_REC_COST <= st->budget)) {
+		if (st->nrecs == st->caprecs) {
+			size_t cap = st->caprecs ? 2*st->caprecs : 4096;
+			sort_rec *a = realloc(st->recs, cap*sizeof(*a));
+			if (a)
+				st->recs = a;
+			sort_rec *b = a ? realloc(st->tmp, cap*sizeof(*b)) : NULL;
+			if (!b)
+				return false;
+			st->tmp = b, st->caprecs = cap;
+		}
+		const char *nl = memchr(p, '\n', end-p);
+		size_t len = (nl ? nl : end) - p;
+		rec_of(&st->recs[st->nrecs++], p, len, p - base, &st->allgood);
+		p = nl ? nl+1 : end;
+	}
+	*pos = p - base;
+	return true;
+}
+
+/* Sorts lines of [arr, arr+len), in runs within st's budget */
+static const char *sort_mapped(sorter *st, const char *arr, size_t len)
+{
+	const char *err = NULL;
+	for (size_t beg = 0, pos; beg < len && !err; beg += pos) {
+		pos = 0;
+		if (!add_lines(st, arr + beg, &pos, arr + len))
+			return "Out of memory";
+		err = sort_records(st, arr + beg, arr + beg + pos,
+			beg + pos == len);
+	}
+	return err;
+}
+
+/* Sorts lines of f, read in blocks kept until they're sorted, in runs
+ * within st's budget.
+ */
+static const char *sort_stream(sorter *st, FILE *f)
+{
+	const char *err = NULL;
+	str in = str_create(BATCH_INBUF);
+	if (str_cap(&in) < BATCH_INBUF)
+		err = "Out of memory";
+	size_t pos = 0, end = 0; /* Of lines not yet added, and whole ones */
+	for (bool eof = false; !err;) {
+		char *e;
+		if (!eof) {
+			if ((err = fill(&in, f, &eof, &e)))
+				break;
+			end = e - str_arr(&in);
+		}
+		const char *arr = str_arr(&in);
+		if (!add_lines(st, arr, &pos, arr + end)) {
+			err = "Out of memory";
+			break;
+		}
+		/* Spill once over budget, or sort the rest at the end */
+		if (pos < end || eof) {
+			bool last = eof && pos == end;
+			err = sort_records(st, arr, arr + pos, last);
+			consume(&in, str_arr(&in) + pos);
+			end -= pos, pos = 0;
+			if (last)
+				break;
+		}
+	}
+	str_destroy(&in);
+	return err;
+}
+
+int sort_lines(const char *path, size_t budget, st_fmtflags fmt,
+		bool reformat)
+{
+	sorter st = {.budget = budget, .fmt = fmt, .reformat = reformat,
+		.out = str_create(BATCH_OUTBUF + ST_S2STR_MAX + 1),
+		.allgood = true};
+	const char *err = NULL;
+	bool isstdin = !strcmp(path, "-");
+	FILE *f = isstdin ? stdin : fopen(path, "rb");
+	if (!f) {
+		fprintf(stderr, "Error: Couldn't open %s.\n", path);
+		str_destroy(&st.out);
+		return EXIT_FAILURE;
+	}
+
+#ifdef HAVE_POSIX
+	/* Regular files are sorted in place, as offsets into them */
+	struct stat sb;
+	void *map = MAP_FAILED;
+	if (!fstat(fileno(f), &sb) && S_ISREG(sb.st_mode) && sb.st_size > 0
+			&& (uint64_t)sb.st_size <= SORT_OFF_MASK)
+		map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE,
+			fileno(f), 0);
+	if (map != MAP_FAILED) {
+		err = sort_mapped(&st, map, sb.st_size);
+		munmap(map, sb.st_size);
+	} else
+#endif
+		err = sort_stream(&st, f);
+
+	if (!err && (!flush(&st.out) || fflush(stdout)))
+		err = "Couldn't write output";
+	if (err)
+		fprintf(stderr, "Error: %s.\n", err);
+	else if (!st.allgood)
+		fprintf(stderr, "Error: Lines that couldn't be converted were "
+			"sorted last.\n");
+	for (size_t i = 0; i < st.nruns; i++)
+		fclose(st.runs[i]);
+	if (!isstdin)
+		fclose(f);
+	free(st.recs), free(st.tmp);
+	str_destroy(&st.out);
+	return st.allgood && !err ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>  /* fprintf, stderr */
+#include <stdlib.h> /* realloc */
+
+#include "cli.h" /* HAVE_POSIX */
+#include "stats.h"
+
+#ifdef ST_STATS
+#ifdef HAVE_POSIX
+#include <pthread.h> /* pthread_mutex_* */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK()   pthread_mutex_lock(&lock)
+#define UNLOCK() pthread_mutex_unlock(&lock)
+#else
+#define LOCK()   ((void)0)
+#define UNLOCK() ((void)0)
+#endif
+
+_Thread_local stats stats_mine;
+_Thread_local uint64_t stats_t0;
+
+static stats total;
+static uint64_t start;
+
+static const char *const names[NSTAGES] = {
+	[STAGE_READ]      = "read",
+	[STAGE_NUM2S]     = "num2s",
+	[STAGE_STR2S]     = "str2s",
+	[STAGE_FMTFLAGS]  = "str2fmtflags",
+	[STAGE_S2STR]     = "s2str",
+	[STAGE_LDTOA]     = "ldtoa",
+	[STAGE_DECOMPOSE] = "decompose",
+	[STAGE_REALLOC]   = "realloc",
+	[STAGE_WRITE]     = "write"
+};
+
+void *stats_realloc(void *p, size_t n)
+{
+	STATS_BEGIN();
+	p = realloc(p, n);
+	STATS_END(STAGE_REALLOC, !p);
+	return p;
+}
+
+void stats_start(void)
+{
+	start = stats_clock();
+}
+
+void stats_merge(void)
+{
+	LOCK();
+	for (size_t s = 0; s < NSTAGES; s++) {
+		total.n[s] += stats_mine.n[s];
+		total.errs[s] += stats_mine.errs[s];
+		total.ticks[s] += stats_mine.ticks[s];
+		for (size_t b = 0; b < STATS_BUCKETS; b++)
+			total.hist[s][b] += stats_mine.hist[s][b];
+	}
+	stats_mine = (stats){0};
+	UNLOCK();
+}
+
+/* Upper bound of ticks of the pth fraction of stage s's calls */
+static unsigned long long percentile(size_t s, double p)
+{
+	unsigned long long want = p*total.n[s] + 0.5, seen = 0;
+	for (size_t b = 0; b < STATS_BUCKETS; b++)
+		if ((seen += total.hist[s][b]) >= want && total.hist[s][b])
+			return b ? (2ull << (b-1)) - 1 : 0;
+	return 0;
+}
+
+void stats_report(void)
+{
+	stats_merge();
+	double wall = stats_clock() - start;
+	fprintf(stderr, "Stats, in " STATS_TICKS " (share of %.0f elapsed, "
+		"summed across threads):\n", wall);
+	fprintf(stderr, "%-12s %12s %10s %14s %10s %7s %10s %10s\n", "stage",
+		"calls", "errors", "total", "per call", "share", "p50 <=",
+		"p99 <=");
+	for (size_t s = 0; s < NSTAGES; s++)
+		if (total.n[s])
+			fprintf(stderr, "%-12s %12llu %10llu %14llu %10.1f "
+				"%6.1f%% %10llu %10llu\n", names[s],
+				total.n[s], total.errs[s], total.ticks[s],
+				(double)total.ticks[s] / total.n[s],
+				wall ? 100 * total.ticks[s] / wall : 0.0,
+				percentile(s, 0.5), percentile(s, 0.99));
+
+	/* Histograms, of buckets with at least 0.1% of calls */
+	fprintf(stderr, "Calls by " STATS_TICKS " per call, upto 2^k:\n");
+	for (size_t s = 0; s < NSTAGES; s++) {
+		if (!total.n[s])
+			continue;
+		fprintf(stderr, "%-12s", names[s]);
+		for (size_t b = 0; b < STATS_BUCKETS; b++) {
+			double pct = 100.0 * total.hist[s][b] / total.n[s];
+			if (pct >= 0.1)
+				fprintf(stderr, " 2^%zu:%.1f%%", b, pct);
+		}
+		fprintf(stderr, "\n");
+	}
+}
+#endif
@@ -0,0 +1,104 @@
+#ifndef STATS_H
+#define STATS_H
+
+/* Counts and times of the CLI's stages, for --stats.
+ *
+ * Compiled in only with -DST_STATS, else the macros below expand to just
+ * the code they wrap, costing nothing.
+ */
+
+#include <stdbool.h> /* bool */
+
+/* Stages timed */
+typedef enum stage {
+	STAGE_READ,      /* Reading input                      */
+	STAGE_NUM2S,     /* st_num2s()                         */
+	STAGE_STR2S,     /* st_str2s()                         */
+	STAGE_FMTFLAGS,  /* st_str2fmtflags()                  */
+	STAGE_S2STR,     /* st_s2str()                         */
+	STAGE_LDTOA,     /* st_ldtoa()                         */
+	STAGE_DECOMPOSE, /* st_decompose()                     */
+	STAGE_REALLOC,   /* Growing str buffers, in str_reserve() and such */
+	STAGE_WRITE,     /* Writing output                     */
+	NSTAGES
+} stage;
+
+#ifdef ST_STATS
+#include <stdint.h> /* uint64_t */
+#include <stdlib.h> /* size_t  */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h> /* __rdtsc */
+#define STATS_TICKS "cycles"
+static inline uint64_t stats_clock(void)
+{
+	return __rdtsc();
+}
+#else
+#include <time.h> /* timespec_get, TIME_UTC */
+#define STATS_TICKS "ns"
+static inline uint64_t stats_clock(void)
+{
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+#endif
+
+/* Histogram buckets of ticks per call: bucket b counts calls of
+ * [2^(b-1), 2^b) ticks, and bucket 0 of 0 ticks.
+ */
+#define STATS_BUCKETS 65
+
+typedef struct stats {
+	unsigned long long n[NSTAGES], errs[NSTAGES], ticks[NSTAGES];
+	unsigned long long hist[NSTAGES][STATS_BUCKETS];
+} stats;
+
+/* This thread's stats since it last merged, and when its stage began */
+extern _Thread_local stats stats_mine;
+extern _Thread_local uint64_t stats_t0;
+
+static inline void stats_end(stage s, bool err)
+{
+	uint64_t d = stats_clock() - stats_t0;
+	unsigned b = 0;
+	for (uint64_t x = d; x; x >>= 1)
+		b++;
+	stats_mine.n[s]++, stats_mine.errs[s] += err;
+	stats_mine.ticks[s] += d, stats_mine.hist[s][b]++;
+}
+
+static inline int stats_st(stage s, int err)
+{
+	stats_end(s, err != 0);
+	return err;
+}
+
+/* realloc(), timed as STAGE_REALLOC */
+void *stats_realloc(void *p, size_t n);
+
+/* Starts the clock --stats reports shares of time against */
+void stats_start(void);
+/* Adds this thread's stats to the totals, for threads ending */
+void stats_merge(void);
+/* Writes the totals to stderr */
+void stats_report(void);
+
+/* Times call, an expression of a st_err, as stage s, counting errors */
+#define STATS_ST(s, call) (stats_t0 = stats_clock(), stats_st((s), (call)))
+/* Times what's between them as stage s, with err true on errors */
+#define STATS_BEGIN()     ((void)(stats_t0 = stats_clock()))
+#define STATS_END(s, err) stats_end((s), (err))
+#define STATS_REALLOC     stats_realloc
+#else
+#define STATS_ST(s, call) (call)
+#define STATS_BEGIN()     ((void)0)
+#define STATS_END(s, err) ((void)0)
+#define STATS_REALLOC     realloc
+#define stats_start()     ((void)0)
+#define stats_merge()     ((void)0)
+#define stats_report()    ((void)0)
+#endif
+
+#endif